@@ -2,11 +2,28 @@
 
 volatile int stop_flag = 0; // Shared flag to signal stop
 
+// Stop the writer once it has written everything queued, and close the log unless it is stdout
+static void close_log(LogQueue *log, FILE *log_file)
+{
+    if (log)
+        log_queue_stop(log);
+    if (log_file != stdout)
+        fclose(log_file);
+}
+
+#ifndef _WIN32
+static void handle_stop_signal(int sig)
+{
+    (void)sig;
+    stop_flag = 1;
+}
+#endif
+
 int main(int argc, char *argv[])
 {
-    if (argc != 3)
+    if (argc < 3 || argc > 8)
     {
-        fprintf(stderr, "Usage: %s <chan_port> <chan_port>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <chan_port> <slot_time> [pure|slotted|csma[:p]|csma-cd[:p]] [shards] [log_file|-] [metrics_port] [epoll|uring]\n", argv[0]);
         return 1;
     }
     // initialize servers list
@@ -20,39 +37,123 @@ int main(int argc, char *argv[])
     head->next = NULL;
     OutputChannel *current = head;
 
-    // initialize prints list
-    PrintsNode *headPrints = (PrintsNode *)malloc(sizeof(PrintsNode));
-    if (!headPrints)
-    {
-        free(head);
-        fprintf(stderr, "Memory allocation failed\n");
-        return 1;
-    }
-    memset(headPrints, 0, sizeof(PrintsNode));
-    headPrints->next = NULL;
-    PrintsNode *currPrints = headPrints;
-
     // initialize input struct
     Input *c1 = (Input *)malloc(sizeof(Input));
     if (!c1)
     {
         fprintf(stderr, "Memory allocation failed\n");
         free(head);
-        free(headPrints);
         return 1;
     }
     memset(c1, 0, sizeof(Input));
     c1->chan_port = atoi(argv[1]);
     c1->slot_time = atoi(argv[2]);
+    if (!mac_parse(argc >= 4 ? argv[3] : "slotted", &c1->mac))
+    {
+        fprintf(stderr, "Unknown MAC protocol: %s\n", argv[3]);
+        free(c1);
+        free(head);
+        return 1;
+    }
+    // Worker threads for station I/O; 0 means one per core
+    int num_shards = argc >= 5 ? atoi(argv[4]) : 1;
+    if (num_shards == 0)
+        num_shards = cpu_count();
+    if (num_shards < 1)
+    {
+        fprintf(stderr, "shards must be 0 or more\n");
+        free(c1);
+        free(head);
+        return 1;
+    }
+    // Socket I/O through readiness polling, or submitted to an io_uring (Linux only)
+    int use_uring = 0;
+    if (argc >= 8)
+    {
+        if (strcmp(argv[7], "uring") == 0)
+            use_uring = 1;
+        else if (strcmp(argv[7], "epoll") != 0)
+        {
+            fprintf(stderr, "Unknown I/O engine: %s\n", argv[7]);
+            free(c1);
+            free(head);
+            return 1;
+        }
+    }
+#ifndef __linux__
+    if (num_shards > 1)
+    {
+        fprintf(stderr, "Sharding needs epoll; running on one thread\n");
+        num_shards = 1;
+    }
+    if (use_uring)
+    {
+        fprintf(stderr, "io_uring is Linux only; using the select loop\n");
+        use_uring = 0;
+    }
+#endif
+    if (use_uring && num_shards > 1)
+    {
+        fprintf(stderr, "The io_uring engine runs on one thread; ignoring shards\n");
+        num_shards = 1;
+    }
+    // Station statistics are streamed here as stations leave, and for the rest at Ctrl+Z
+    FILE *log_file = stdout;
+    if (argc >= 6 && strcmp(argv[5], "-") != 0)
+    {
+        log_file = fopen(argv[5], "w");
+        if (!log_file)
+        {
+            fprintf(stderr, "Failed to open log file: %s\n", argv[5]);
+            free(c1);
+            free(head);
+            return 1;
+        }
+    }
+
+    // initialize socket -> station index
+    StationTable table;
+    if (!station_table_init(&table, 64))
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        close_log(NULL, log_file);
+        free(c1);
+        free(head);
+        return 1;
+    }
+#ifdef _WIN32
     // Initialize Winsock
     WSADATA wsaData;
     int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
     if (iResult != NO_ERROR)
     {
         fprintf(stderr, "Error at WSAStartup(): %d\n", iResult);
+        close_log(NULL, log_file);
         free(c1);
+        station_table_free(&table);
+        free_list_1(head);
+        return 1;
+    }
+#else
+    // Ctrl+Z arrives as SIGTSTP on a POSIX terminal; no SA_RESTART so epoll_wait() wakes up
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTSTP, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // a station closing mid-broadcast must not kill the channel
+#endif
+
+    LogQueue log;
+    if (!log_queue_start(&log, log_file))
+    {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        close_log(NULL, log_file);
+        free(c1);
+        station_table_free(&table);
         free_list_1(head);
-        free_list_2(headPrints);
         return 1;
     }
 
@@ -61,10 +162,13 @@ int main(int argc, char *argv[])
     if (tcp_s == INVALID_SOCKET)
     {
         fprintf(stderr, "Error creating socket: %d\n", WSAGetLastError());
+#ifdef _WIN32
         WSACleanup();
+#endif
         free(c1);
+        station_table_free(&table);
         free_list_1(head);
-        free_list_2(headPrints);
+        close_log(&log, log_file);
         return 1;
     }
 
@@ -73,21 +177,18 @@ int main(int argc, char *argv[])
     my_addr.sin_addr.s_addr = INADDR_ANY;
     my_addr.sin_port = htons(c1->chan_port);
 
-    struct sockaddr_in server_addr;
-    int server_addr_len = sizeof(server_addr);
-
-    char *data_buffer;
-    int bytes_received;
-
     // Bind the socket to the port
     if (bind(tcp_s, (SOCKADDR *)&my_addr, sizeof(my_addr)) == SOCKET_ERROR)
     {
         fprintf(stderr, "Bind failed: %d\n", WSAGetLastError());
         closesocket(tcp_s);
+#ifdef _WIN32
         WSACleanup();
+#endif
         free(c1);
+        station_table_free(&table);
         free_list_1(head);
-        free_list_2(headPrints);
+        close_log(&log, log_file);
         return 1;
     }
 
@@ -95,50 +196,132 @@ int main(int argc, char *argv[])
     {
         fprintf(stderr, "Listen failed: %d\n", WSAGetLastError());
         closesocket(tcp_s);
+#ifdef _WIN32
         WSACleanup();
+#endif
         free(c1);
+        station_table_free(&table);
         free_list_1(head);
-        free_list_2(headPrints);
+        close_log(&log, log_file);
         return 1;
     }
 
-    fd_set master_set, read_fds;
+    // Live counters on a local HTTP port, for watching saturation while it happens
+    int metrics_port = argc >= 7 ? atoi(argv[6]) : 0;
+    if (metrics_port < 0 || metrics_port > 65535 || (metrics_port > 0 && !metrics_start(metrics_port, c1->slot_time)))
+    {
+        if (metrics_port < 0 || metrics_port > 65535)
+            fprintf(stderr, "Invalid metrics port: %s\n", argv[6]);
+        closesocket(tcp_s);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        free(c1);
+        station_table_free(&table);
+        free_list_1(head);
+        close_log(&log, log_file);
+        return 1;
+    }
+
+#ifdef __linux__
+    if (num_shards > 1)
+    {
+        int ok = run_sharded(tcp_s, c1, num_shards, &log);
+        closesocket(tcp_s);
+        free(c1);
+        station_table_free(&table);
+        free_list_1(head);
+        metrics_stop();
+        close_log(&log, log_file);
+        return ok ? 0 : 1;
+    }
+    if (use_uring)
+    {
+        int ok = run_uring(tcp_s, c1, &log);
+        closesocket(tcp_s);
+        free(c1);
+        station_table_free(&table);
+        free_list_1(head);
+        metrics_stop();
+        close_log(&log, log_file);
+        return ok ? 0 : 1;
+    }
+#endif
+
+    NoiseTemplate noise = {NULL, 0};
+
+    // Frames are collected until the slot boundary, then the slot is resolved by its sender count
+    SlotClock clock;
+    slot_clock_init(&clock, c1->slot_time);
+    int senders_seen = 0; // senders counted at the last update_slot_end()
+
+#ifdef _WIN32
+    fd_set master_set, read_fds, write_fds;
     FD_ZERO(&master_set);
     FD_SET(tcp_s, &master_set); // Add the listening socket to the master set
 
-    char buffer[HEADER_SIZE + 1]; // Buffer for incoming messages
     // Connection was recieved
     while (1)
     {
         if (_kbhit()) { // Check if a key was pressed
             int ch = _getch(); // Read key (non-blocking)
-            if (ch == 26) stop_flag = 1; // ASCII 26 = Ctrl+Z 
+            if (ch == 26) stop_flag = 1; // ASCII 26 = Ctrl+Z
         }
 
         if (stop_flag) {
             printf("\nCtrl+Z detected. Finalizing logs...\n");
-        
+
             OutputChannel *ptr = head->next;
             while (ptr) {
-                log_server_stats(ptr, &currPrints);
+                log_server_stats(ptr, &log);
                 ptr = ptr->next;
             }
             break;
-        }        
+        }
+
+        if (slot_clock_remaining(&clock) == 0)
+        {
+            // Handle collisions or successful transmission
+            resolve_slot(head, &noise);
+            slot_clock_advance(&clock);
+            senders_seen = 0;
+
+            // Frames already read ahead won't make their socket readable again
+            OutputChannel *ptr = head->next;
+            while (ptr)
+            {
+                OutputChannel *next = ptr->next;
+                if (rx_buffered(ptr) && receive_frame(head, ptr) == RX_CLOSED)
+                {
+                    FD_CLR(ptr->socket, &master_set);
+                    disconnect_server(head, &current, &table, ptr, &log);
+                }
+                ptr = next;
+            }
+        }
 
         read_fds = master_set;
-        // Set the timeout for select
-        struct timeval timeout;
-        timeout.tv_sec = c1->slot_time / 1000;           // Convert milliseconds to seconds
-        timeout.tv_usec = (c1->slot_time % 1000) * 1000; // Remaining milliseconds to microseconds
+        // A station gets one frame per slot; leave the rest of its input queued in the socket
+        for (OutputChannel *sender = head->next_sender; sender; sender = sender->next_sender)
+        {
+            FD_CLR(sender->socket, &read_fds);
+        }
 
-        int max_fd = 0;
-        for (u_int i = 0; i < master_set.fd_count; i++)
+        // Stations with replies still queued wait for buffer space
+        FD_ZERO(&write_fds);
+        for (OutputChannel *ptr = head->next; ptr; ptr = ptr->next)
         {
-            if ((int)master_set.fd_array[i] > max_fd)
-                max_fd = (int)master_set.fd_array[i];
+            if (ptr->tx_head)
+                FD_SET(ptr->socket, &write_fds);
         }
-        int ready = select(0, &read_fds, NULL, NULL, &timeout); // still Windows uses 0
+
+        // Sleep at most until the slot boundary
+        uint64_t wait_ns = slot_clock_remaining(&clock);
+        struct timeval timeout;
+        timeout.tv_sec = (long)(wait_ns / NS_PER_SEC);                  // Convert nanoseconds to seconds
+        timeout.tv_usec = (long)((wait_ns % NS_PER_SEC + 999) / 1000); // Remainder to microseconds, rounded up
+
+        int ready = select(0, &read_fds, &write_fds, NULL, &timeout); // still Windows uses 0
 
         if (ready == SOCKET_ERROR)
         {
@@ -151,324 +334,1132 @@ int main(int argc, char *argv[])
             continue;
         }
 
-        for (u_int i = 0; i < master_set.fd_count; i++)
+        for (u_int i = 0; i < write_fds.fd_count; i++)
+        {
+            OutputChannel *ptr = station_table_find(&table, write_fds.fd_array[i]);
+            if (ptr && !flush_tx(ptr))
+            {
+                fprintf(stderr, "Error sending data: %d\n", WSAGetLastError());
+                clear_tx(ptr); // the read side will see the disconnect
+            }
+        }
+
+        for (u_int i = 0; i < read_fds.fd_count; i++)
         {
             SOCKET socket = read_fds.fd_array[i];
-            if (FD_ISSET(socket, &read_fds)) // check if socket is ready
+            if (socket == tcp_s) // New connection on the listening socket
             {
-                if (socket == tcp_s) // New connection on the listening socket
+                OutputChannel *new_OutputChannel = accept_server(tcp_s, &current);
+                if (new_OutputChannel && index_station(&table, &current, new_OutputChannel))
                 {
-                    SOCKET new_server = accept(tcp_s, (SOCKADDR *)&server_addr, &server_addr_len);
-                    if (new_server != INVALID_SOCKET)
-                    {
-                        FD_SET(new_server, &master_set); // Add the new socket to the master set
-                        OutputChannel *new_OutputChannel = (OutputChannel *)malloc(sizeof(OutputChannel));
-                        if (!new_OutputChannel)
-                        {
-                            fprintf(stderr, "Memory allocation failed\n");
-                            continue; // Skip this connection but keep the server running
-                        }
-                        new_OutputChannel->sender_address = _strdup(inet_ntoa(server_addr.sin_addr));
-                        if (!new_OutputChannel->sender_address)
-                        {
-                            fprintf(stderr, "Memory allocation failed\n");
-                            free(new_OutputChannel);
-                            continue;
-                        }
-                        new_OutputChannel->socket = new_server;
-                        new_OutputChannel->avg_bw = 0;
-                        new_OutputChannel->frame_size = 0;
-                        new_OutputChannel->num_packets = 0;
-                        new_OutputChannel->total_collisions = 0;
-                        new_OutputChannel->send_in_slot = 0;
-                        new_OutputChannel->data_size = 0;
-                        new_OutputChannel->port_num = ntohs(server_addr.sin_port);
-                        new_OutputChannel->data_buffer = NULL;
-                        new_OutputChannel->next = NULL;
-                        new_OutputChannel->start_time = GetTickCount();
-                        new_OutputChannel->end_time = new_OutputChannel->start_time;
-                        current->next = new_OutputChannel;
-                        current = new_OutputChannel;
-                    }
-                    printf("Server connected, socket: %d\n",new_server);
+                    FD_SET(new_OutputChannel->socket, &master_set); // Add the new socket to the master set
                 }
-                else // listen to messages
+            }
+            else // listen to messages
+            {
+                // Find the corresponding server
+                OutputChannel *ptr = station_table_find(&table, socket);
+                if (!ptr)
+                    continue;
+
+                if (receive_frame(head, ptr) == RX_CLOSED)
                 {
-                    if (FD_ISSET(socket, &read_fds))
-                    {
-                        FD_CLR(socket, &read_fds);
-                        memset(buffer, 0, HEADER_SIZE + 1);
-                        int header_received = recv(socket, buffer, HEADER_SIZE, 0);
-                        buffer[HEADER_SIZE] = '\0';
-
-                        if (header_received > 0)
-                        {
-                            // Find the corresponding server
-                            OutputChannel *ptr = head->next;
-                            while (ptr)
-                            {
-                                if (ptr->socket == socket)
-                                {
-                                    // Extract frame size from header
-                                    ptr->frame_size = ((uint8_t)buffer[14] << 24) |
-                                                      ((uint8_t)buffer[15] << 16) |
-                                                      ((uint8_t)buffer[16] << 8) |
-                                                      ((uint8_t)buffer[17]);
-                                    ptr->num_packets++;
-                                    ptr->send_in_slot = 1; // Mark this server as active in this slot
-
-                                    // Read the data if frame size is valid
-                                    if (ptr->frame_size > 0)
-                                    {
-                                        // Allocate buffer for this server's data
-                                        ptr->data_buffer = (char *)malloc(ptr->frame_size + 1);
-                                        memset(ptr->data_buffer, 0, ptr->frame_size + 1); // Initialize buffer
-                                        if (!ptr->data_buffer)
-                                        {
-                                            fprintf(stderr, "Memory allocation failed\n");
-                                            break;
-                                        }
-
-                                        // Receive the data portion
-                                        ptr->data_size = recv(socket, ptr->data_buffer, ptr->frame_size, 0);
-                                        if (ptr->data_size <= 0)
-                                        {
-                                            free(ptr->data_buffer);
-                                            ptr->data_buffer = NULL;
-                                            ptr->data_size = 0;
-                                            break;
-                                        }
-                                        ptr->data_buffer[ptr->frame_size] = '\0'; // Null-terminate the data
-                                    }
-                                    break;
-                                }
-                                ptr = ptr->next;
-                            }
-                        }
-                        else
-                        {
-                            // server disconnected
-                            OutputChannel *prev = head;
-                            OutputChannel *ptr = head->next;
-                            while (ptr)
-                            {
-                                if (ptr->socket == socket)
-                                {
-                                    break;
-                                }
-                                prev = ptr;
-                                ptr = ptr->next;
-                            }
-                            if (ptr)
-                            {
-                                ptr->end_time = GetTickCount();
-                                double elapsed_time = (ptr->end_time - ptr->start_time) / 1000.0; // in seconds
-
-                                // Avoid division by zero
-                                if (elapsed_time > 0)
-                                {
-                                    ptr->avg_bw = (double)(ptr->frame_size * ptr->num_packets * 8) / (elapsed_time * 1000000); // in Mbps
-                                }
-                                else
-                                {
-                                    ptr->avg_bw = 0;
-                                }
-                                printf("Server disconnected, socket: %d\n",ptr->socket);
-                                if (currPrints != headPrints){
-                                    PrintsNode *newPrints = (PrintsNode *)malloc(sizeof(PrintsNode));
-                                    if (!newPrints)
-                                    {
-                                        free(head);
-                                        fprintf(stderr, "Memory allocation failed\n");
-                                        return 1;
-                                    }
-                                    memset(newPrints, 0, sizeof(PrintsNode));
-                                    newPrints->next = NULL;
-                                    currPrints->next = newPrints;
-                                    currPrints = newPrints;
-                                }
-                                log_server_stats(ptr, &currPrints);
-                                
-                                prev->next = ptr->next;
-
-                                if (current == ptr)
-                                {
-                                    current = prev;
-                                }
-
-                                free(ptr->sender_address);
-                                if (ptr->data_buffer)
-                                {
-                                    free(ptr->data_buffer);
-                                }
-                                free(ptr);
-                                closesocket(socket);
-                                FD_CLR(socket, &master_set);
-                            }
-                        }
-                    }
+                    // server disconnected
+                    disconnect_server(head, &current, &table, ptr, &log);
+                    FD_CLR(socket, &master_set);
                 }
             }
         }
-        // Handle collisions or successful transmission
-        if (master_set.fd_count > 2) // Collision detected
-        {
-            // Prepare noise signal
-            const char *noise = "!!!!!!!!!!!!!!!!!NOISE!!!!!!!!!!!!!!!!!";
-            int noise_len = (int)strlen(noise);
-            char *padded_noise = NULL;
+        update_slot_end(&c1->mac, &clock, head, &senders_seen);
+    }
+#else
+    // Edge-triggered epoll: a wakeup costs O(ready sockets), not O(connected sockets)
+    int epfd = epoll_create1(0);
+    if (epfd < 0)
+    {
+        fprintf(stderr, "epoll_create1 failed: %d\n", errno);
+        closesocket(tcp_s);
+        free(c1);
+        station_table_free(&table);
+        free_list_1(head);
+        metrics_stop();
+        close_log(&log, log_file);
+        return 1;
+    }
+    set_nonblocking(tcp_s);
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL; // NULL marks the listening socket, stations carry their OutputChannel
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tcp_s, &ev);
+
+    struct epoll_event events[MAX_EVENTS];
+
+    // Stations whose socket may still hold unread bytes. An edge is reported only once,
+    // so a station stays on this list until a non-blocking peek comes back empty.
+    OutputChannel **ready_list = NULL;
+    int num_ready = 0;
+    int ready_cap = 0;
+
+    while (1)
+    {
+        if (stop_flag) {
+            printf("\nCtrl+Z detected. Finalizing logs...\n");
 
-            // Update collision counters for all active servers
             OutputChannel *ptr = head->next;
-            while (ptr)
-            {
-                if (ptr->send_in_slot == 1)
-                {
-                    ptr->total_collisions++;
-                    padded_noise = (char *)malloc(ptr->frame_size);
-                    memset(padded_noise, 0, ptr->frame_size);
-                    memcpy(padded_noise, noise, noise_len);
-                    SOCKET out_socket = ptr->socket;
-                    if (out_socket != tcp_s)
-                    {
-                        if (send(out_socket, padded_noise, ptr->frame_size, 0) == SOCKET_ERROR)
-                        {
-                            fprintf(stderr, "Error sending noise: %d\n", WSAGetLastError());
-                        }
-                    }
-                }
+            while (ptr) {
+                log_server_stats(ptr, &log);
                 ptr = ptr->next;
             }
-            reset_all_send_flags(head);
+            break;
         }
-        else if (master_set.fd_count == 2) // Exactly one sender, no collision
+
+        if (slot_clock_remaining(&clock) == 0)
+        {
+            // Handle collisions or successful transmission
+            resolve_slot(head, &noise);
+            slot_clock_advance(&clock);
+            senders_seen = 0;
+        }
+
+        // Sleep until the slot boundary, unless a station that hasn't sent yet has input buffered
+        int wait_ms = (int)((slot_clock_remaining(&clock) + NS_PER_MS - 1) / NS_PER_MS);
+        for (int i = 0; i < num_ready && wait_ms > 0; i++)
         {
-            // Find the active server
-            OutputChannel *active_ptr = head->next;
-            while (active_ptr)
+            if (!ready_list[i]->send_in_slot)
+                wait_ms = 0;
+        }
+        int ready = epoll_wait(epfd, events, MAX_EVENTS, wait_ms);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            printf("epoll_wait failed: %d\n", errno);
+            break;
+        }
+
+        for (int i = 0; i < ready; i++)
+        {
+            OutputChannel *ptr = (OutputChannel *)events[i].data.ptr;
+            if (!ptr) // New connection(s) on the listening socket
+            {
+                OutputChannel *new_OutputChannel;
+                while ((new_OutputChannel = accept_server(tcp_s, &current)) != NULL)
+                {
+                    if (!index_station(&table, &current, new_OutputChannel))
+                        continue;
+                    memset(&ev, 0, sizeof(ev));
+                    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                    ev.data.ptr = new_OutputChannel;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, new_OutputChannel->socket, &ev);
+                }
+            }
+            else
             {
-                if (active_ptr->send_in_slot == 1)
+                if ((events[i].events & EPOLLOUT) && ptr->tx_head && !flush_tx(ptr))
                 {
-                    // Send data from this server to all servers
-                    for (u_int j = 0; j < master_set.fd_count; j++)
+                    fprintf(stderr, "Error sending data: %d\n", errno);
+                    clear_tx(ptr); // the read side will see the disconnect
+                }
+                if (ptr->readable || !(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)))
+                    continue;
+
+                if (num_ready == ready_cap)
+                {
+                    int new_cap = ready_cap ? ready_cap * 2 : MAX_EVENTS;
+                    OutputChannel **grown = (OutputChannel **)realloc(ready_list, new_cap * sizeof(OutputChannel *));
+                    if (!grown)
                     {
-                        SOCKET out_socket = master_set.fd_array[j];
-                        if (out_socket != tcp_s) // Don't send to the listening socket
-                        {
-                            if (send(out_socket, active_ptr->data_buffer, active_ptr->data_size, 0) == SOCKET_ERROR)
-                            {
-                                fprintf(stderr, "Error sending data: %d\n", WSAGetLastError());
-                            }
-                        }
+                        fprintf(stderr, "Memory allocation failed\n");
+                        continue;
                     }
-                    break;
+                    ready_list = grown;
+                    ready_cap = new_cap;
                 }
-                active_ptr = active_ptr->next;
+                ptr->readable = 1;
+                ready_list[num_ready++] = ptr;
             }
-            reset_all_send_flags(head);
         }
 
-        // If no active servers (active_count == 0), do nothing
+        // Read one frame per slot from every ready station, keeping the ones with more input pending
+        int still_ready = 0;
+        for (int i = 0; i < num_ready; i++)
+        {
+            OutputChannel *ptr = ready_list[i];
+            if (ptr->send_in_slot)
+            {
+                // Already transmitted in this slot; its next frame belongs to a later one
+                ready_list[still_ready++] = ptr;
+                continue;
+            }
+            RxStatus status = receive_frame(head, ptr);
+            if (status == RX_CLOSED)
+            {
+                // server disconnected (close() also drops it from the epoll set)
+                disconnect_server(head, &current, &table, ptr, &log);
+                continue;
+            }
+            if (status == RX_PENDING)
+            {
+                // Drained to EAGAIN, the next edge re-arms it
+                ptr->readable = 0;
+                continue;
+            }
+            ready_list[still_ready++] = ptr;
+        }
+        num_ready = still_ready;
+        update_slot_end(&c1->mac, &clock, head, &senders_seen);
     }
-    print_logs(headPrints);
+    free(ready_list);
+    close(epfd);
+#endif
     closesocket(tcp_s);
-    WSACleanup();
     free(c1);
+    if (noise.frame)
+        shared_frame_release(noise.frame);
+    station_table_free(&table);
     free_list_1(head);
-    free_list_2(headPrints);
+    metrics_stop(); // after the stations have let go of their cells
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    close_log(&log, log_file);
     return 0;
 }
 
-void print_logs(PrintsNode *head) {
-    PrintsNode *curr = head;
-    while (curr) {
-        printf("%s", curr->print);
-        curr = curr->next;
+// Accept a pending connection and append a fresh record for it to the servers list
+OutputChannel *accept_server(SOCKET tcp_s, OutputChannel **current)
+{
+    struct sockaddr_in server_addr;
+    socklen_t server_addr_len = sizeof(server_addr);
+
+    SOCKET new_server = accept(tcp_s, (SOCKADDR *)&server_addr, &server_addr_len);
+    if (new_server == INVALID_SOCKET)
+    {
+        return NULL;
     }
+    return add_station(new_server, &server_addr, current);
 }
 
+// Append a record for an accepted connection to the servers list
+OutputChannel *add_station(SOCKET new_server, const struct sockaddr_in *addr, OutputChannel **current)
+{
+    const struct sockaddr_in server_addr = *addr;
+    OutputChannel *new_OutputChannel = (OutputChannel *)malloc(sizeof(OutputChannel));
+    if (!new_OutputChannel)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        closesocket(new_server);
+        return NULL;
+    }
+    memset(new_OutputChannel, 0, sizeof(OutputChannel));
+    new_OutputChannel->sender_address = _strdup(inet_ntoa(server_addr.sin_addr));
+    if (!new_OutputChannel->sender_address)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(new_OutputChannel);
+        closesocket(new_server);
+        return NULL;
+    }
+    set_nonblocking(new_server); // frames are reassembled across reads, never waited for
+    set_nodelay(new_server);
+    new_OutputChannel->socket = new_server;
+    new_OutputChannel->port_num = ntohs(server_addr.sin_port);
+    new_OutputChannel->data_buffer = NULL;
+    new_OutputChannel->tx_head = NULL;
+    new_OutputChannel->tx_tail = NULL;
+    new_OutputChannel->next = NULL;
+    new_OutputChannel->prev = *current;
+    new_OutputChannel->start_time = now_ns();
+    new_OutputChannel->end_time = new_OutputChannel->start_time;
+    new_OutputChannel->metrics = metrics_station_open(new_OutputChannel->sender_address, new_OutputChannel->port_num);
+    (*current)->next = new_OutputChannel;
+    *current = new_OutputChannel;
+    printf("Server connected, socket: %d\n", (int)new_server);
+    return new_OutputChannel;
+}
 
-void free_list_1(OutputChannel *head)
+// Index a station add_station() just appended. If the index can't take it the station is
+// refused: unlinked, freed and its connection closed. Returns 0 then.
+int index_station(StationTable *table, OutputChannel **current, OutputChannel *station)
 {
-    OutputChannel *current = head;
-    while (current != NULL)
+    if (station_table_insert(table, station))
+        return 1;
+    fprintf(stderr, "Refusing socket %d\n", (int)station->socket);
+    station->prev->next = station->next;
+    if (station->next)
     {
-        OutputChannel *temp = current;
-        current = current->next;
-        free(temp->sender_address);
-        free(temp);
+        station->next->prev = station->prev;
     }
+    if (*current == station)
+    {
+        *current = station->prev;
+    }
+    metrics_station_close(station->metrics);
+    free_server(station);
+    return 0;
+}
+
+// True once enough of the header is in to see that it is a v2 one
+static int rx_is_v2(const OutputChannel *ptr)
+{
+    return ptr->rx_header_got >= 14 && (uint8_t)ptr->rx_header[12] == (ETHERTYPE_V2 >> 8) &&
+           (uint8_t)ptr->rx_header[13] == (ETHERTYPE_V2 & 0xFF);
+}
+
+// Header bytes the frame being received has: v2 adds the CRC to the v1 layout
+static int rx_header_len(const OutputChannel *ptr)
+{
+    return rx_is_v2(ptr) ? HEADER_V2_SIZE : HEADER_SIZE;
+}
+
+// True if bytes already read from the station are waiting to be parsed
+int rx_buffered(const OutputChannel *ptr)
+{
+    return ptr->rx_ahead_pos < ptr->rx_ahead_len;
+}
+
+// Where the frame being reassembled takes its next bytes: the rest of the header, then the
+// payload. Returns how many it still wants there.
+static int rx_want(OutputChannel *ptr, char **dst)
+{
+    int header_len = rx_header_len(ptr);
+    if (ptr->rx_header_got < header_len)
+    {
+        *dst = ptr->rx_header + ptr->rx_header_got;
+        return header_len - ptr->rx_header_got;
+    }
+    *dst = ptr->data_buffer + ptr->rx_payload_got;
+    return ptr->frame_size - ptr->rx_payload_got;
+}
+
+// A payload remainder of at least RX_AHEAD_SIZE is read straight into place rather than through
+// the read-ahead buffer. Returns its length and destination, or 0 if the next read is buffered.
+int rx_direct_want(OutputChannel *ptr, char **dst)
+{
+    if (ptr->rx_header_got < rx_header_len(ptr))
+        return 0;
+    int want = rx_want(ptr, dst);
+    return want >= RX_AHEAD_SIZE ? want : 0;
+}
+
+// Account for "received" bytes just stored where rx_want() pointed. RX_FRAME means the frame is
+// whole and has joined this slot's senders; RX_CLOSED, that the stream can't be parsed.
+RxStatus rx_advance(OutputChannel *head, OutputChannel *ptr, int received)
+{
+    if (ptr->rx_header_got < rx_header_len(ptr))
+    {
+        ptr->rx_header_got += received;
+        if (ptr->rx_header_got < rx_header_len(ptr))
+            return RX_PENDING; // the wanted length grows to the v2 size once the ethertype is in
+
+        // Extract frame size from header
+        uint32_t frame_size = ((uint32_t)(uint8_t)ptr->rx_header[14] << 24) |
+                              ((uint32_t)(uint8_t)ptr->rx_header[15] << 16) |
+                              ((uint32_t)(uint8_t)ptr->rx_header[16] << 8) |
+                              ((uint32_t)(uint8_t)ptr->rx_header[17]);
+        if (frame_size > MAX_FRAME_SIZE)
+        {
+            fprintf(stderr, "Invalid frame size %u from socket %d\n", frame_size, (int)ptr->socket);
+            return RX_CLOSED;
+        }
+        ptr->frame_size = (int)frame_size;
+        ptr->rx_payload_got = 0;
+        if (ptr->metrics)
+            atomic_store_explicit(&ptr->metrics->frame_size, ptr->frame_size, memory_order_relaxed);
+
+        station_reclaim(ptr);
+        // Stations keep their frame size, so this allocates once and is reused from then on. A
+        // buffer lent to a fan-out alternates with the spare that came back from the last one.
+        if (!ptr->data_buffer && ptr->spare_buffer)
+        {
+            ptr->data_buffer = ptr->spare_buffer;
+            ptr->data_capacity = ptr->spare_capacity;
+            ptr->spare_buffer = NULL;
+            ptr->spare_capacity = 0;
+        }
+        if (ptr->frame_size + 1 > ptr->data_capacity)
+        {
+            char *grown = (char *)realloc(ptr->data_buffer, ptr->frame_size + 1);
+            if (!grown)
+            {
+                fprintf(stderr, "Memory allocation failed\n");
+                return RX_CLOSED;
+            }
+            ptr->data_buffer = grown;
+            ptr->data_capacity = ptr->frame_size + 1;
+        }
+        ptr->data_buffer[ptr->frame_size] = '\0'; // Null-terminate the data
+    }
+    else
+    {
+        ptr->rx_payload_got += received;
+    }
+    if (ptr->rx_payload_got < ptr->frame_size)
+        return RX_PENDING;
+
+    // Whole frame in hand: it takes part in this slot
+    ptr->rx_corrupt = 0;
+    if (rx_is_v2(ptr))
+    {
+        FrameHeader fh;
+        header_v2_parse(ptr->rx_header, &fh);
+        ptr->rx_corrupt = !(fh.flags & FRAME_DATA) || fh.payload_len > (uint32_t)ptr->frame_size ||
+                          frame_crc(ptr->rx_header, ptr->data_buffer, ptr->frame_size, NULL, 0) != fh.crc;
+    }
+    ptr->data_size = ptr->frame_size;
+    ptr->rx_header_got = 0;
+    ptr->rx_payload_got = 0;
+    ptr->num_packets++;
+    if (ptr->metrics)
+        atomic_store_explicit(&ptr->metrics->frames, (uint64_t)ptr->num_packets, memory_order_relaxed);
+    ptr->send_in_slot = 1; // Mark this server as active in this slot
+    ptr->next_sender = head->next_sender;
+    head->next_sender = ptr;
+    return RX_FRAME;
 }
 
-void free_list_2(PrintsNode *head)
+// Parse what the read-ahead buffer holds, up to the end of one frame. Never touches the socket:
+// RX_PENDING means the buffer ran out first.
+RxStatus rx_parse(OutputChannel *head, OutputChannel *ptr)
 {
-    PrintsNode *current = head;
+    while (!ptr->send_in_slot && rx_buffered(ptr))
+    {
+        char *dst;
+        int n = rx_want(ptr, &dst);
+        if (n > ptr->rx_ahead_len - ptr->rx_ahead_pos)
+            n = ptr->rx_ahead_len - ptr->rx_ahead_pos;
+        memcpy(dst, ptr->rx_ahead + ptr->rx_ahead_pos, n);
+        ptr->rx_ahead_pos += n;
+        RxStatus status = rx_advance(head, ptr, n);
+        if (status != RX_PENDING)
+            return status;
+    }
+    return ptr->send_in_slot ? RX_FRAME : RX_PENDING;
+}
+
+// Collect header and payload bytes across as many reads as the socket needs. Stops once a whole
+// frame is buffered, since a station transmits at most one frame per slot. Reads go into the
+// station's read-ahead buffer, so a station that pipelines has its next frames brought in by the
+// same recv(); they are parsed from there, one per slot, without another system call.
+RxStatus receive_frame(OutputChannel *head, OutputChannel *ptr)
+{
+    while (!ptr->send_in_slot)
+    {
+        RxStatus status = rx_parse(head, ptr);
+        if (status != RX_PENDING)
+            return status;
+
+        // Refill the read-ahead buffer, or read a long payload remainder straight into place
+        char *dst;
+        int direct = rx_direct_want(ptr, &dst);
+        if (!direct && !ptr->rx_ahead)
+        {
+            ptr->rx_ahead = (char *)malloc(RX_AHEAD_SIZE);
+            if (!ptr->rx_ahead)
+            {
+                fprintf(stderr, "Memory allocation failed\n");
+                return RX_CLOSED;
+            }
+        }
+        int received = direct ? recv(ptr->socket, dst, direct, 0) : recv(ptr->socket, ptr->rx_ahead, RX_AHEAD_SIZE, 0);
+        if (received == 0)
+        {
+            return RX_CLOSED;
+        }
+        if (received == SOCKET_ERROR)
+        {
+#ifndef _WIN32
+            if (errno == EINTR)
+                continue;
+#endif
+            return SOCKET_WOULD_BLOCK() ? RX_PENDING : RX_CLOSED;
+        }
+        if (direct)
+        {
+            status = rx_advance(head, ptr, received);
+            if (status != RX_PENDING)
+                return status;
+        }
+        else
+        {
+            ptr->rx_ahead_pos = 0;
+            ptr->rx_ahead_len = received;
+        }
+    }
+    return RX_FRAME;
+}
+
+SharedFrame *shared_frame_wrap(char *buf)
+{
+    SharedFrame *frame = (SharedFrame *)malloc(sizeof(SharedFrame));
+    if (!frame)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    frame->buf = buf;
+    frame->refs = 1;
+    frame->owner = NULL;
+    frame->capacity = 0;
+    return frame;
+}
+
+// A data buffer lent out by station_send() has been sent everywhere: the station reads into it
+// again, or keeps it as its spare if it has started on another frame meanwhile
+static void buffer_return(OutputChannel *ptr, char *buf, int capacity)
+{
+    ptr->lent = NULL;
+    if (!ptr->data_buffer)
+    {
+        ptr->data_buffer = buf;
+        ptr->data_capacity = capacity;
+    }
+    else if (!ptr->spare_buffer)
+    {
+        ptr->spare_buffer = buf;
+        ptr->spare_capacity = capacity;
+    }
+    else
+    {
+        free(buf);
+    }
+}
+
+// On the sharded channel other shards drop their references to a lent buffer on their own
+// threads. The station's reference goes last, from its own shard, so the buffer comes back there.
+void station_reclaim(OutputChannel *ptr)
+{
+    if (ptr->lent_held && atomic_load(&ptr->lent->refs) == 1)
+    {
+        ptr->lent_held = 0;
+        shared_frame_release(ptr->lent);
+    }
+}
+
+void shared_frame_release(SharedFrame *frame)
+{
+    if (--frame->refs == 0)
+    {
+        if (frame->owner)
+            buffer_return(frame->owner, frame->buf, frame->capacity);
+        else
+            free(frame->buf);
+        free(frame);
+    }
+}
+
+// Gather-write up to 2 * TX_BATCH segments in one call
+static long write_segments(SOCKET socket, const char **bufs, const int *lens, int count)
+{
+#ifdef _WIN32
+    WSABUF vec[2 * TX_BATCH];
+    for (int i = 0; i < count; i++)
+    {
+        vec[i].buf = (CHAR *)bufs[i];
+        vec[i].len = (ULONG)lens[i];
+    }
+    DWORD sent_bytes = 0;
+    if (WSASend(socket, vec, count, &sent_bytes, 0, NULL, NULL) == SOCKET_ERROR)
+        return SOCKET_ERROR;
+    return (long)sent_bytes;
+#else
+    struct iovec vec[2 * TX_BATCH];
+    for (int i = 0; i < count; i++)
+    {
+        vec[i].iov_base = (void *)bufs[i];
+        vec[i].iov_len = (size_t)lens[i];
+    }
+    long written;
+    do
+    {
+        written = (long)writev(socket, vec, count);
+    } while (written < 0 && errno == EINTR);
+    return written;
+#endif
+}
+
+// Send a fanned-out frame to one station. Whatever the socket can't take now is queued by
+// reference and finished by flush_tx(). Returns 0 on a hard socket error.
+int station_send(OutputChannel *dst, Fanout *fan)
+{
+    long sent = 0;
+    if (!dst->tx_head && !dst->tx_async)
+    {
+        const char *bufs[2] = {fan->hdr, fan->data};
+        int lens[2] = {fan->hdr_len, fan->len};
+        sent = fan->hdr_len > 0 ? write_segments(dst->socket, bufs, lens, 2)
+                                : write_segments(dst->socket, bufs + 1, lens + 1, 1);
+        if (sent == fan->hdr_len + fan->len)
+            return 1;
+        if (sent == SOCKET_ERROR)
+        {
+            if (!SOCKET_WOULD_BLOCK())
+                return 0;
+            sent = 0;
+        }
+    }
+
+    if (!fan->frame)
+    {
+        // First short write of this fan-out: the owner's buffer becomes shared until every copy is
+        // out. It then comes back to the owner, which meanwhile reads into its spare or a new one.
+        // One buffer is lent at a time; a later one is freed when done instead.
+        fan->frame = shared_frame_wrap(fan->owner->data_buffer);
+        if (!fan->frame)
+            return 0;
+        if (!fan->owner->lent)
+        {
+            fan->frame->owner = fan->owner;
+            fan->frame->capacity = fan->owner->data_capacity;
+            fan->owner->lent = fan->frame;
+        }
+        fan->owner->data_buffer = NULL;
+        fan->owner->data_capacity = 0;
+    }
+    TxItem *item = (TxItem *)malloc(sizeof(TxItem));
+    if (!item)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    item->hdr_len = fan->hdr_len;
+    if (fan->hdr_len > 0)
+        memcpy(item->hdr, fan->hdr, fan->hdr_len); // the station's header slot is reused next frame
+    item->frame = fan->frame;
+    item->frame->refs++;
+    item->data = fan->data;
+    item->len = fan->len;
+    item->offset = (int)sent;
+    item->next = NULL;
+    if (dst->tx_tail)
+        dst->tx_tail->next = item;
+    else
+        dst->tx_head = item;
+    dst->tx_tail = item;
+    return 1;
+}
+
+// Gather the unsent parts of up to TX_BATCH queued frames, 2 * TX_BATCH segments at most.
+// Returns the segment count; *total gets their byte count.
+int tx_gather(const OutputChannel *ptr, const char **bufs, int *lens, long *total)
+{
+    int count = 0;
+    int items = 0;
+    *total = 0;
+    for (TxItem *item = ptr->tx_head; item && items < TX_BATCH; item = item->next, items++)
+    {
+        if (item->offset < item->hdr_len)
+        {
+            bufs[count] = item->hdr + item->offset;
+            lens[count] = item->hdr_len - item->offset;
+            *total += lens[count++];
+            bufs[count] = item->data;
+            lens[count] = item->len;
+        }
+        else
+        {
+            bufs[count] = item->data + (item->offset - item->hdr_len);
+            lens[count] = item->len - (item->offset - item->hdr_len);
+        }
+        *total += lens[count++];
+    }
+    return count;
+}
+
+// Retire frames "written" bytes covered, leaving the offset inside a partial one
+void tx_advance(OutputChannel *ptr, long written)
+{
+    long left = written;
+    while (ptr->tx_head && left >= ptr->tx_head->hdr_len + ptr->tx_head->len - ptr->tx_head->offset)
+    {
+        TxItem *done = ptr->tx_head;
+        left -= done->hdr_len + done->len - done->offset;
+        ptr->tx_head = done->next;
+        shared_frame_release(done->frame);
+        free(done);
+    }
+    if (!ptr->tx_head)
+        ptr->tx_tail = NULL;
+    else
+        ptr->tx_head->offset += (int)left;
+}
+
+// Push as much of the station's queue as the socket takes, several queued frames per call.
+// Returns 0 on a hard socket error.
+int flush_tx(OutputChannel *ptr)
+{
+    while (ptr->tx_head)
+    {
+        const char *bufs[2 * TX_BATCH];
+        int lens[2 * TX_BATCH];
+        long total;
+        int count = tx_gather(ptr, bufs, lens, &total);
+
+        long written = write_segments(ptr->socket, bufs, lens, count);
+        if (written == SOCKET_ERROR)
+            return SOCKET_WOULD_BLOCK();
+        tx_advance(ptr, written);
+        if (written < total)
+            return 1; // kernel buffer full, wait for the next writable event
+    }
+    return 1;
+}
+
+void clear_tx(OutputChannel *ptr)
+{
+    while (ptr->tx_head)
+    {
+        TxItem *item = ptr->tx_head;
+        ptr->tx_head = item->next;
+        shared_frame_release(item->frame);
+        free(item);
+    }
+    ptr->tx_tail = NULL;
+}
+
+// Log a departing station and unlink it from the servers list. The record itself stays until
+// free_server().
+void detach_server(OutputChannel *head, OutputChannel **current, StationTable *table, OutputChannel *ptr, LogQueue *log)
+{
+    printf("Server disconnected, socket: %d\n", (int)ptr->socket);
+    log_server_stats(ptr, log);
+
+    // Drop it from this slot's senders before the record goes away
+    if (ptr->send_in_slot)
+    {
+        OutputChannel *sender = head;
+        while (sender->next_sender && sender->next_sender != ptr)
+        {
+            sender = sender->next_sender;
+        }
+        if (sender->next_sender)
+        {
+            sender->next_sender = ptr->next_sender;
+        }
+    }
+
+    ptr->prev->next = ptr->next;
+    if (ptr->next)
+    {
+        ptr->next->prev = ptr->prev;
+    }
+    if (*current == ptr)
+    {
+        *current = ptr->prev;
+    }
+    station_table_remove(table, ptr->socket);
+    metrics_station_close(ptr->metrics);
+}
+
+// Close a detached station's socket and free its record
+void free_server(OutputChannel *ptr)
+{
+    closesocket(ptr->socket);
+    clear_tx(ptr);
+    if (ptr->lent)
+    {
+        ptr->lent->owner = NULL; // still queued for other stations, freed by the last of them
+        if (ptr->lent_held)
+            shared_frame_release(ptr->lent);
+    }
+    free(ptr->sender_address);
+    if (ptr->data_buffer)
+    {
+        free(ptr->data_buffer);
+    }
+    free(ptr->spare_buffer);
+    free(ptr->rx_ahead);
+    free(ptr);
+}
+
+// Log a departing station, unlink it from the servers list and close its socket
+void disconnect_server(OutputChannel *head, OutputChannel **current, StationTable *table, OutputChannel *ptr, LogQueue *log)
+{
+    detach_server(head, current, table, ptr, log);
+    free_server(ptr);
+}
+
+static int has_ethertype(const char *header, uint16_t ethertype)
+{
+    return (uint8_t)header[12] == (ethertype >> 8) && (uint8_t)header[13] == (ethertype & 0xFF);
+}
+
+// Header a station's frame is answered with so the station can match the reply: none for v1
+// stop-and-wait frames, the frame's own header for windowed and v2 ones
+int reply_header_len(const OutputChannel *ptr)
+{
+    if (has_ethertype(ptr->rx_header, ETHERTYPE_V2))
+        return HEADER_V2_SIZE;
+    return has_ethertype(ptr->rx_header, ETHERTYPE_SEQ) ? HEADER_SIZE : 0;
+}
+
+// Control replies own no buffer, but a reply queued behind a slow socket needs a frame to hold on
+// to. This one is never released to zero, so it is never freed.
+static const char compact_replies[2] = {(char)COMPACT_ACK, (char)COMPACT_NOISE};
+static SharedFrame control_frame = {(char *)compact_replies, 1, NULL, 0};
+
+// Answer a v2 station's frame with FRAME_ACK or FRAME_NOISE: a bare header naming the frame, or a
+// single byte if the station asked for compact replies
+static void send_control(OutputChannel *ptr, uint8_t flags)
+{
+    FrameHeader fh;
+    header_v2_parse(ptr->rx_header, &fh);
+    char hdr[HEADER_V2_SIZE];
+    Fanout fan = {NULL, 0, compact_replies + (flags == FRAME_ACK ? 0 : 1), 1, &control_frame, NULL};
+    if (!(fh.flags & FRAME_COMPACT))
+    {
+        build_header_v2(hdr, flags, fh.station_id, fh.seq, 0, 0);
+        header_v2_seal(hdr, crc32c(0, hdr, HEADER_SIZE));
+        fan.hdr = hdr;
+        fan.hdr_len = HEADER_V2_SIZE;
+        fan.len = 0;
+    }
+    if (!station_send(ptr, &fan))
+    {
+        fprintf(stderr, "Error sending %s: %d\n", flags == FRAME_ACK ? "ACK" : "noise", WSAGetLastError());
+        clear_tx(ptr);
+    }
+}
+
+// Noise reply of frame_size bytes, growing the shared template only for a new largest size.
+// Replies still queued on a slow station keep the previous template alive until they drain.
+SharedFrame *noise_frame(NoiseTemplate *noise, int frame_size)
+{
+    if (!noise->frame || frame_size > noise->size)
+    {
+        int marker_len = (int)strlen(NOISE_MARKER);
+        char *buf = (char *)calloc(frame_size > 0 ? frame_size : 1, 1);
+        if (!buf)
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            return NULL;
+        }
+        memcpy(buf, NOISE_MARKER, frame_size < marker_len ? frame_size : marker_len);
+        SharedFrame *frame = shared_frame_wrap(buf);
+        if (!frame)
+        {
+            free(buf);
+            return NULL;
+        }
+        if (noise->frame)
+            shared_frame_release(noise->frame);
+        noise->frame = frame;
+        noise->size = frame_size;
+    }
+    return noise->frame;
+}
+
+// Decide a slot by its sender count. lone_corrupt says the only frame, if there was just one,
+// failed its CRC: a frame that arrived damaged is as lost as a collided one.
+SlotOutcome settle_slot(int senders, int lone_corrupt)
+{
+    SlotOutcome outcome = classify_slot(senders);
+    if (outcome == SLOT_SUCCESS && lone_corrupt)
+        outcome = SLOT_COLLISION;
+    return outcome;
+}
+
+// Close the slot: noise to every sender on collision, or forward the single frame to all
+SlotOutcome resolve_slot(OutputChannel *head, NoiseTemplate *noise)
+{
+    int senders = count_active(head);
+    SlotOutcome outcome = settle_slot(senders, senders == 1 && head->next_sender->rx_corrupt);
+    metrics_slot(outcome, senders);
+    deliver_slot(head, noise, outcome, NULL);
+    return outcome;
+}
+
+// Send a decided outcome to the stations of one list. winner is the frame to forward on success
+// when it may belong to another list (sharded channel); NULL forwards this list's only sender.
+void deliver_slot(OutputChannel *head, NoiseTemplate *noise, SlotOutcome outcome, Fanout *winner)
+{
+    if (outcome == SLOT_COLLISION) // Collision detected
+    {
+        // Update collision counters for all active servers
+        OutputChannel *ptr = head->next_sender;
+        while (ptr)
+        {
+            ptr->total_collisions++;
+            if (ptr->metrics)
+                atomic_store_explicit(&ptr->metrics->collisions, (uint64_t)ptr->total_collisions, memory_order_relaxed);
+            int hdr_len = reply_header_len(ptr);
+            SharedFrame *padded_noise = NULL;
+            if (hdr_len == HEADER_V2_SIZE)
+                send_control(ptr, FRAME_NOISE);
+            else
+                padded_noise = noise_frame(noise, ptr->frame_size);
+            if (padded_noise)
+            {
+                // Windowed stations get their header back so they know which frame collided
+                Fanout fan = {hdr_len > 0 ? ptr->rx_header : NULL, hdr_len, padded_noise->buf, ptr->frame_size, padded_noise, NULL};
+                if (!station_send(ptr, &fan))
+                {
+                    fprintf(stderr, "Error sending noise: %d\n", WSAGetLastError());
+                    clear_tx(ptr);
+                }
+            }
+            ptr = ptr->next_sender;
+        }
+        reset_all_send_flags(head);
+    }
+    else if (outcome == SLOT_SUCCESS && winner)
+    {
+        // The frame is shared already, so a short write only takes another reference. A v2
+        // sender, on this list if it is ours, gets an ACK instead of its own frame back.
+        for (OutputChannel *out = head->next; out; out = out->next)
+        {
+            if (out == head->next_sender && winner->hdr_len == HEADER_V2_SIZE)
+                send_control(out, FRAME_ACK);
+            else if (!station_send(out, winner))
+            {
+                fprintf(stderr, "Error sending data: %d\n", WSAGetLastError());
+                clear_tx(out);
+            }
+        }
+        reset_all_send_flags(head);
+    }
+    else if (outcome == SLOT_SUCCESS) // Exactly one sender, no collision
+    {
+        OutputChannel *active_ptr = head->next_sender;
+        if (active_ptr && active_ptr->rx_corrupt)
+        {
+            deliver_slot(head, noise, SLOT_COLLISION, NULL); // reaches here from a shard
+            return;
+        }
+        if (active_ptr)
+        {
+            // Send data from this server to all servers, every destination referencing the same buffer
+            int hdr_len = reply_header_len(active_ptr);
+            Fanout fan = {hdr_len > 0 ? active_ptr->rx_header : NULL, hdr_len, active_ptr->data_buffer, active_ptr->data_size, NULL, active_ptr};
+            OutputChannel *out = head->next;
+            while (out)
+            {
+                if (out == active_ptr && hdr_len == HEADER_V2_SIZE)
+                    send_control(out, FRAME_ACK);
+                else if (!station_send(out, &fan))
+                {
+                    fprintf(stderr, "Error sending data: %d\n", WSAGetLastError());
+                    clear_tx(out);
+                }
+                out = out->next;
+            }
+            if (fan.frame)
+                shared_frame_release(fan.frame); // queued copies hold their own references
+        }
+        reset_all_send_flags(head);
+    }
+
+    // If no active servers (active_count == 0), do nothing
+}
+
+void slot_clock_init(SlotClock *clock, int slot_time)
+{
+    clock->slot_time = (slot_time > 0 ? (uint64_t)slot_time : 1) * NS_PER_MS;
+    clock->origin = now_ns();
+    clock->slot_index = 0;
+    clock->slot_end = clock->origin + clock->slot_time;
+}
+
+// Nanoseconds left in the current slot, 0 once its boundary has passed
+uint64_t slot_clock_remaining(const SlotClock *clock)
+{
+    uint64_t now = now_ns();
+    return clock->slot_end > now ? clock->slot_end - now : 0;
+}
+
+// End the current slot delay_ns from now instead of at its boundary
+void slot_clock_restart(SlotClock *clock, uint64_t delay_ns)
+{
+    clock->slot_end = now_ns() + delay_ns;
+}
+
+// Apply the MAC's slot rules once new frames have been read. Pure ALOHA keeps the vulnerable
+// period open for one frame time (slot_time) after every arrival, so frames that overlap at all
+// collide. Collision detection closes the slot as soon as a second sender shows up.
+void update_slot_end(const MacStrategy *mac, SlotClock *clock, OutputChannel *head, int *senders_seen)
+{
+    int senders = count_active(head);
+    if (senders == *senders_seen)
+        return;
+    *senders_seen = senders;
+    if (mac->collision_detect && senders >= 2)
+        slot_clock_restart(clock, 0);
+    else if (!mac->slotted)
+        slot_clock_restart(clock, clock->slot_time);
+}
+
+// Move to the slot containing "now"; slots skipped while busy had no receptions and are idle
+void slot_clock_advance(SlotClock *clock)
+{
+    uint64_t elapsed = now_ns() - clock->origin;
+    clock->slot_index = elapsed / clock->slot_time;
+    clock->slot_end = clock->origin + (clock->slot_index + 1) * clock->slot_time;
+}
+
+static size_t station_hash(SOCKET socket, size_t capacity)
+{
+    // Fibonacci hashing spreads both small POSIX fds and Winsock handles (multiples of 4)
+    uint64_t h = (uint64_t)socket * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 32) & (capacity - 1);
+}
+
+int station_table_init(StationTable *table, size_t capacity)
+{
+    size_t cap = 16;
+    while (cap < capacity)
+        cap <<= 1;
+    table->slots = (OutputChannel **)calloc(cap, sizeof(OutputChannel *));
+    if (!table->slots)
+        return 0;
+    table->capacity = cap;
+    table->count = 0;
+    return 1;
+}
+
+void station_table_free(StationTable *table)
+{
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+OutputChannel *station_table_find(const StationTable *table, SOCKET socket)
+{
+    size_t mask = table->capacity - 1;
+    size_t i = station_hash(socket, table->capacity);
+    while (table->slots[i])
+    {
+        if (table->slots[i]->socket == socket)
+            return table->slots[i];
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+int station_table_insert(StationTable *table, OutputChannel *station)
+{
+    // Keep the load factor under 1/2 so probe sequences stay short
+    if ((table->count + 1) * 2 > table->capacity)
+    {
+        StationTable grown;
+        if (!station_table_init(&grown, table->capacity * 2))
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 0;
+        }
+        for (size_t j = 0; j < table->capacity; j++)
+        {
+            if (table->slots[j])
+                station_table_insert(&grown, table->slots[j]);
+        }
+        free(table->slots);
+        *table = grown;
+    }
+
+    size_t mask = table->capacity - 1;
+    size_t i = station_hash(station->socket, table->capacity);
+    while (table->slots[i])
+        i = (i + 1) & mask;
+    table->slots[i] = station;
+    table->count++;
+    return 1;
+}
+
+void station_table_remove(StationTable *table, SOCKET socket)
+{
+    size_t mask = table->capacity - 1;
+    size_t i = station_hash(socket, table->capacity);
+    while (table->slots[i] && table->slots[i]->socket != socket)
+        i = (i + 1) & mask;
+    if (!table->slots[i])
+        return;
+
+    // Backward-shift deletion: pull later entries of the probe run into the hole
+    table->slots[i] = NULL;
+    table->count--;
+    size_t j = i;
+    while (1)
+    {
+        j = (j + 1) & mask;
+        if (!table->slots[j])
+            break;
+        size_t home = station_hash(table->slots[j]->socket, table->capacity);
+        // Leave the entry alone if its home lies cyclically in (i, j]
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        table->slots[i] = table->slots[j];
+        table->slots[j] = NULL;
+        i = j;
+    }
+}
+
+void free_list_1(OutputChannel *head)
+{
+    OutputChannel *current = head;
     while (current != NULL)
     {
-        PrintsNode *temp = current;
+        OutputChannel *temp = current;
         current = current->next;
+        clear_tx(temp);
+        if (temp->lent)
+        {
+            temp->lent->owner = NULL;
+            if (temp->lent_held)
+                shared_frame_release(temp->lent);
+        }
+        metrics_station_close(temp->metrics);
+        free(temp->sender_address);
+        free(temp->data_buffer);
+        free(temp->spare_buffer);
+        free(temp->rx_ahead);
         free(temp);
     }
 }
 
 void reset_all_send_flags(OutputChannel *head)
 {
-    OutputChannel *current = head->next; // Skip head node
+    OutputChannel *current = head->next_sender; // Only this slot's senders have anything to reset
     while (current != NULL)
     {
-        current->send_in_slot = 0; // Reset flag
-        if (current->data_buffer)
-        {
-            free(current->data_buffer);
-            current->data_buffer = NULL;
-        }
+        OutputChannel *next = current->next_sender;
+        current->send_in_slot = 0; // Reset flag; the data buffer stays with the station
         current->data_size = 0;
-        current = current->next;
+        current->next_sender = NULL;
+        current = next;
     }
+    head->next_sender = NULL;
 }
 
 int count_active(OutputChannel *head)
 {
     int count = 0;
-    OutputChannel *current = head->next; // Include the head node in the count
+    OutputChannel *current = head->next_sender; // Walk this slot's senders only
     while (current != NULL)
     {
-        if (current->send_in_slot == 1) // Check if a packet was sent in the slot
-        {
-            count++;
-        }
-        current = current->next;
+        count++;
+        current = current->next_sender;
     }
     return count;
 }
 
-void log_server_stats(OutputChannel *ptr, PrintsNode **currPrints) {
-    ptr->end_time = GetTickCount();
-    double elapsed_time = (ptr->end_time - ptr->start_time) / 1000.0;
+// Hand a station's statistics to the log writer; formatting and file I/O happen on its thread
+void log_server_stats(OutputChannel *ptr, LogQueue *log) {
+    ptr->end_time = now_ns();
+    double elapsed_time = (double)(ptr->end_time - ptr->start_time) / NS_PER_SEC;
 
     if (elapsed_time > 0)
-        ptr->avg_bw = (double)(ptr->frame_size * ptr->num_packets * 8) / (elapsed_time * 1000000);
+        ptr->avg_bw = (double)ptr->num_packets * ptr->frame_size * 8 / (elapsed_time * 1000000);
     else
         ptr->avg_bw = 0;
 
-    // Create a new log node if not the first
-    if (*currPrints != NULL && (*currPrints)->print[0] != '\0') {
-        PrintsNode *newPrints = (PrintsNode *)malloc(sizeof(PrintsNode));
-        if (!newPrints) {
-            fprintf(stderr, "Memory allocation failed for log node.\n");
-            return;
-        }
-        memset(newPrints, 0, sizeof(PrintsNode));
-        (*currPrints)->next = newPrints;
-        *currPrints = newPrints;
-    }
-
-    snprintf((*currPrints)->print, sizeof((*currPrints)->print),
-             "From %s port %d: %d frames, %d collisions, average bandwidth: %.3f Mbps\n",
-             ptr->sender_address,
-             ptr->port_num,
-             ptr->num_packets,
-             ptr->total_collisions,
-             ptr->avg_bw);
+    LogRecord record;
+    snprintf(record.address, sizeof(record.address), "%s", ptr->sender_address);
+    record.port = ptr->port_num;
+    record.frames = ptr->num_packets;
+    record.collisions = ptr->total_collisions;
+    record.avg_bw = ptr->avg_bw;
+    log_queue_push(log, &record);
 }
-
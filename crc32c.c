@@ -0,0 +1,158 @@
+#include "header.h"
+
+// CRC32C (Castagnoli, reflected polynomial 0x82F63B78). Every v2 frame is summed once by its
+// station and once more by the channel, so this touches every byte on the wire. x86 CPUs with
+// SSE4.2 have a crc32 instruction for exactly this polynomial, eight bytes at a time; anything
+// else gets slicing-by-8 tables. The choice is made once, on first use.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32C_HW 1
+#include <nmmintrin.h>
+#endif
+
+#define CRC32C_POLY 0x82F63B78
+#define CRC32C_STRIPE 4096 // bytes per stream when a long buffer is summed as three interleaved streams
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const uint8_t *p, size_t len);
+
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32c_stripe_shift[2]; // x^(8 * CRC32C_STRIPE) and x^(16 * CRC32C_STRIPE) mod P
+static crc32c_fn crc32c_impl;
+static atomic_int crc32c_state; // 0 not set up, 1 being set up, 2 ready
+
+// Slicing-by-8: one lookup in each of eight tables per eight input bytes
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len && ((uintptr_t)p & 7))
+    {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 8)
+    {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+// a * b modulo P, both bit-reflected. Used to move a CRC past bytes summed separately.
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m; m >>= 1)
+    {
+        if (a & m)
+            product ^= b;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+#ifdef CRC32C_HW
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len && ((uintptr_t)p & 7))
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    // One crc32 takes three cycles but a new one can start every cycle, so long buffers are cut
+    // into three stripes summed side by side. The CRC is linear: the stripes' CRCs combine by
+    // shifting the earlier ones past the bytes that follow them.
+    while (len >= 3 * CRC32C_STRIPE)
+    {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        for (size_t i = 0; i < CRC32C_STRIPE; i += 8)
+        {
+            uint64_t w0, w1, w2;
+            memcpy(&w0, p + i, 8);
+            memcpy(&w1, p + CRC32C_STRIPE + i, 8);
+            memcpy(&w2, p + 2 * CRC32C_STRIPE + i, 8);
+            crc64 = _mm_crc32_u64(crc64, w0);
+            crc1 = _mm_crc32_u64(crc1, w1);
+            crc2 = _mm_crc32_u64(crc2, w2);
+        }
+        crc64 = crc32c_multiply(crc32c_stripe_shift[1], (uint32_t)crc64) ^
+                crc32c_multiply(crc32c_stripe_shift[0], (uint32_t)crc1) ^ (uint32_t)crc2;
+        p += 3 * CRC32C_STRIPE;
+        len -= 3 * CRC32C_STRIPE;
+    }
+    while (len >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while (len >= 4)
+    {
+        uint32_t word;
+        memcpy(&word, p, 4);
+        crc = _mm_crc32_u32(crc, word);
+        p += 4;
+        len -= 4;
+    }
+    while (len--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif
+
+// Build the tables and pick the kernel. The first caller does it; any other thread arriving
+// meanwhile waits, which happens at most once per process.
+static void crc32c_setup(void)
+{
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&crc32c_state, &expected, 1))
+    {
+        while (atomic_load_explicit(&crc32c_state, memory_order_acquire) != 2)
+        {
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc32c_table[0][i] = c;
+    }
+    for (int t = 1; t < 8; t++)
+    {
+        for (int i = 0; i < 256; i++)
+            crc32c_table[t][i] = crc32c_table[0][crc32c_table[t - 1][i] & 0xFF] ^ (crc32c_table[t - 1][i] >> 8);
+    }
+    // Summing zero bytes from a register of x^0 leaves x^(8 * bytes) in it
+    static const uint8_t zeros[CRC32C_STRIPE];
+    crc32c_stripe_shift[0] = crc32c_sw(1u << 31, zeros, CRC32C_STRIPE);
+    crc32c_stripe_shift[1] = crc32c_multiply(crc32c_stripe_shift[0], crc32c_stripe_shift[0]);
+    crc32c_impl = crc32c_sw;
+#ifdef CRC32C_HW
+    if (__builtin_cpu_supports("sse4.2"))
+        crc32c_impl = crc32c_sse42;
+#endif
+    atomic_store_explicit(&crc32c_state, 2, memory_order_release);
+}
+
+// Extend crc, the CRC32C of the bytes so far (0 for none), over len more bytes
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+    if (atomic_load_explicit(&crc32c_state, memory_order_acquire) != 2)
+        crc32c_setup();
+    return ~crc32c_impl(~crc, (const uint8_t *)data, len);
+}
@@ -0,0 +1,244 @@
+#include "header.h"
+
+// Frame and input helpers shared by the server and the load generator
+
+void build_header(char *packet, int frame_size, uint16_t ethertype, uint16_t station_id, uint32_t seq)
+{
+    // Destination MAC (6 bytes)
+    memcpy(packet, "\xAA\xBB\xCC\xDD\xEE\xFF", 6);
+
+    if (ethertype == ETHERTYPE_SEQ)
+    {
+        // Source MAC field: station id (2 bytes) and sequence number (4 bytes), big-endian
+        packet[6] = (station_id >> 8) & 0xFF;
+        packet[7] = station_id & 0xFF;
+        packet[8] = (seq >> 24) & 0xFF;
+        packet[9] = (seq >> 16) & 0xFF;
+        packet[10] = (seq >> 8) & 0xFF;
+        packet[11] = seq & 0xFF;
+    }
+    else
+    {
+        // Append src MAC (6 bytes)
+        memcpy(packet + 6, "\x11\x22\x33\x44\x55\x66", 6);
+    }
+
+    // Append ethertype (2 bytes)
+    packet[12] = (ethertype >> 8) & 0xFF;
+    packet[13] = ethertype & 0xFF;
+
+    // Append frame size (4 bytes, big-endian)
+    packet[14] = (frame_size >> 24) & 0xFF;
+    packet[15] = (frame_size >> 16) & 0xFF;
+    packet[16] = (frame_size >> 8) & 0xFF;
+    packet[17] = frame_size & 0xFF;
+}
+
+// Receive exactly len bytes. Returns len, or what recv() returned when the stream ended or failed.
+int recv_all(SOCKET sockfd, char *buf, int len)
+{
+    int got = 0;
+    while (got < len)
+    {
+        int n = recv(sockfd, buf + got, len - got, 0);
+        if (n <= 0)
+            return n;
+        got += n;
+    }
+    return got;
+}
+
+// Send header, payload and zero padding up to frame_size as one gather write, finishing any
+// partial write. Returns the bytes sent or SOCKET_ERROR.
+int send_frame(SOCKET sockfd, const char *header, int header_len, const char *payload, int payload_len, int frame_size, const char *padding)
+{
+    const char *bufs[3] = {header, payload, padding};
+    int lens[3] = {header_len, payload_len, frame_size - payload_len};
+    int total = 0;
+    int first = 0;
+    while (first < 3)
+    {
+#ifdef _WIN32
+        WSABUF vec[3];
+        for (int i = first; i < 3; i++)
+        {
+            vec[i - first].buf = (CHAR *)bufs[i];
+            vec[i - first].len = (ULONG)lens[i];
+        }
+        DWORD sent_bytes = 0;
+        if (WSASend(sockfd, vec, 3 - first, &sent_bytes, 0, NULL, NULL) == SOCKET_ERROR)
+            return SOCKET_ERROR;
+        long sent = (long)sent_bytes;
+#else
+        struct iovec vec[3];
+        for (int i = first; i < 3; i++)
+        {
+            vec[i - first].iov_base = (void *)bufs[i];
+            vec[i - first].iov_len = (size_t)lens[i];
+        }
+        long sent = (long)writev(sockfd, vec, 3 - first);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return SOCKET_ERROR;
+        }
+#endif
+        total += (int)sent;
+        while (first < 3 && sent >= lens[first])
+        {
+            sent -= lens[first];
+            first++;
+        }
+        if (first < 3)
+        {
+            bufs[first] += sent;
+            lens[first] -= (int)sent;
+        }
+    }
+    return total;
+}
+
+int input_open(InputSource *in, const char *file_name)
+{
+    memset(in, 0, sizeof(InputSource));
+#ifdef _WIN32
+    in->file_handle = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (in->file_handle != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(in->file_handle, &size) && size.QuadPart > 0)
+        {
+            in->map_handle = CreateFileMappingA(in->file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (in->map_handle)
+                in->map = (const char *)MapViewOfFile(in->map_handle, FILE_MAP_READ, 0, 0, 0);
+            if (in->map)
+            {
+                in->size = (size_t)size.QuadPart;
+                return 1;
+            }
+            if (in->map_handle)
+                CloseHandle(in->map_handle);
+            in->map_handle = NULL;
+        }
+        CloseHandle(in->file_handle);
+        in->file_handle = INVALID_HANDLE_VALUE;
+    }
+#else
+    int fd = open(file_name, O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+                close(fd); // the mapping keeps the file referenced
+                in->map = (const char *)map;
+                in->size = (size_t)st.st_size;
+                return 1;
+            }
+        }
+        close(fd);
+    }
+#endif
+    // Empty files, pipes and devices fall back to buffered reads
+    in->f = fopen(file_name, "rb");
+    return in->f != NULL;
+}
+
+// Payload of the next frame and its length in file bytes, or NULL at end of file
+const char *input_next_frame(InputSource *in, char *scratch, int frame_size, int *payload_len)
+{
+    if (in->map)
+    {
+        if (in->offset >= in->size)
+            return NULL;
+        size_t left = in->size - in->offset;
+        const char *payload = in->map + in->offset;
+        *payload_len = left < (size_t)frame_size ? (int)left : frame_size;
+        in->offset += *payload_len;
+        return payload;
+    }
+    if (!in->f)
+    {
+        if (in->synthetic_left == 0)
+            return NULL;
+        in->synthetic_left--;
+        for (int i = 0; i < frame_size; i += 8)
+        {
+            uint64_t bytes = rng_next(&in->pattern);
+            memcpy(scratch + i, &bytes, frame_size - i < 8 ? (size_t)(frame_size - i) : 8);
+        }
+        *payload_len = frame_size;
+        return scratch;
+    }
+    memset(scratch, 0, frame_size);
+    size_t read_bytes = fread(scratch, 1, frame_size, in->f);
+    if (read_bytes == 0)
+        return NULL;
+    *payload_len = frame_size; // scratch is already zero-padded
+    return scratch;
+}
+
+void input_close(InputSource *in)
+{
+    if (in->map)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(in->map);
+        CloseHandle(in->map_handle);
+        CloseHandle(in->file_handle);
+#else
+        munmap((void *)in->map, in->size);
+#endif
+        in->map = NULL;
+    }
+    if (in->f)
+    {
+        fclose(in->f);
+        in->f = NULL;
+    }
+}
+
+// Frames start..start + len of a mapped source. The slice borrows the mapping, so only the whole
+// source is ever closed.
+void input_slice(InputSource *in, const InputSource *whole, size_t start, size_t len)
+{
+    memset(in, 0, sizeof(InputSource));
+    in->map = whole->map + start;
+    in->size = len;
+}
+
+// "frames" frames of random bytes, different for every stream, so no station ever takes another
+// station's forwarded frame for its own echo
+void input_synthetic(InputSource *in, uint64_t frames, uint64_t seed, uint64_t stream)
+{
+    memset(in, 0, sizeof(InputSource));
+    in->synthetic_left = frames;
+    rng_seed(&in->pattern, ~seed, stream);
+}
+
+// Fill in the transfer figures and print the summary, without the latency percentiles
+void print_summary(OutputServer *out, const char *name, int frame_size, int num_frames, int total_transmissions, uint64_t elapsed_ns)
+{
+    out->num_of_packets = num_frames;
+    out->file_name = (char *)name;
+    out->file_size = num_frames * frame_size;
+    out->total_time = (int)(elapsed_ns / NS_PER_MS);
+
+    if (num_frames > 0 && elapsed_ns > 0)
+    {
+        out->avg_transmissions = (double)total_transmissions / num_frames;
+        out->avg_bw = (double)num_frames * frame_size * 8 * 1000.0 / (double)elapsed_ns; // bits per ns * 1000 = Mbps
+    }
+    fprintf(stderr, "\nSent file %s\n", out->file_name);
+    fprintf(stderr, "Result: %s \n", out->success ? "Success :)" : "Failure :(");
+    fprintf(stderr, "File size: %d Bytes (%d frames)\n", out->file_size, out->num_of_packets);
+    fprintf(stderr, "Total transfer time: %d milliseconds\n", out->total_time);
+    fprintf(stderr, "Transmissions/frame: average %.3f, maximum %d\n", out->avg_transmissions, out->max_transmissions);
+    fprintf(stderr, "Average bandwidth: %.3f Mbps\n", out->avg_bw);
+}
@@ -4,15 +4,236 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <winsock2.h>
 #include <stdint.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
 #include <windows.h>
 #include <conio.h>
 
+typedef int socklen_t;
+
+#define SOCKET_WOULD_BLOCK() (WSAGetLastError() == WSAEWOULDBLOCK)
+#define SOCKET_TIMED_OUT() (WSAGetLastError() == WSAETIMEDOUT)
+#else
+// POSIX build: map the Winsock names used throughout the code onto BSD sockets
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sched.h>
+#endif
+
+typedef int SOCKET;
+typedef uint32_t DWORD;
+typedef int BOOL;
+typedef struct sockaddr SOCKADDR;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define closesocket close
+#define WSAGetLastError() errno
+#define _strdup strdup
+#define SOCKET_WOULD_BLOCK() (errno == EAGAIN || errno == EWOULDBLOCK)
+#define SOCKET_TIMED_OUT() SOCKET_WOULD_BLOCK() // SO_RCVTIMEO expiry
+
+static inline void Sleep(DWORD ms)
+{
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+#endif
+
+// Minimal thread and lock wrappers: Win32 threads and critical sections, pthreads elsewhere
+#ifdef _WIN32
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef DWORD thread_ret_t;
+#define THREAD_CALL WINAPI
+#define mutex_init(m) InitializeCriticalSection(m)
+#define mutex_destroy(m) DeleteCriticalSection(m)
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+#else
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef void *thread_ret_t;
+#define THREAD_CALL
+#define mutex_init(m) pthread_mutex_init(m, NULL)
+#define mutex_destroy(m) pthread_mutex_destroy(m)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#endif
+
+static inline int thread_start(thread_t *thread, thread_ret_t(THREAD_CALL *fn)(void *), void *arg)
+{
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, fn, arg, 0, NULL);
+    return *thread != NULL;
+#else
+    return pthread_create(thread, NULL, fn, arg) == 0;
+#endif
+}
+
+static inline void thread_join(thread_t thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+static inline int cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+#define NS_PER_MS 1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
+// Monotonic clock in nanoseconds, used for slot boundaries, frame latency and bandwidth
+static inline uint64_t now_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    uint64_t ticks = (uint64_t)counter.QuadPart;
+    uint64_t hz = (uint64_t)freq.QuadPart;
+    return ticks / hz * NS_PER_SEC + ticks % hz * NS_PER_SEC / hz;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+#endif
+}
+
 // Shared constants
 #define HEADER_SIZE 18
-#define MAX_SERVERS 50
+#define ETHERTYPE_DATA 0x0801 // stop-and-wait frame, the channel replies with the bare payload
+#define ETHERTYPE_SEQ 0x0802  // windowed frame: source MAC field carries a 2-byte station id and a
+                              // 4-byte sequence number, and replies are sent with the header in front
+#define ETHERTYPE_V2 0x0803   // wire format v2, see wire.c: flags, station id, sequence number and a CRC32C
+#define HEADER_V2_SIZE 22     // the v1 layout followed by the CRC
+#define HEADER_MAX_SIZE HEADER_V2_SIZE
+#define WIRE_VERSION 2        // first header byte of a v2 frame
+#define FRAME_DATA 0x01       // v2 flags: a station's frame, echoed to the others
+#define FRAME_NOISE 0x02      // control frame: the named frame collided
+#define FRAME_ACK 0x04        // control frame: the named frame got through
+#define FRAME_COMPACT 0x08    // DATA flag: answer with a one-byte ACK or NOISE instead of a control frame.
+                              // Only for stop-and-wait stations, which have a single frame to answer for.
+#define COMPACT_ACK 0x84      // one-byte replies; never WIRE_VERSION, which opens every forwarded frame
+#define COMPACT_NOISE 0x82
+#ifdef _WIN32
+#define MAX_SERVERS 50 // select() is bounded by FD_SETSIZE (64) on Winsock
+#else
+#define MAX_SERVERS 4096
+#define MAX_EVENTS 256 // epoll events harvested per wakeup
+#endif
 #define MSG_SIZE 1024
+#define TX_BATCH 16 // queued frames handed to one writev()/WSASend()
+#define MAX_FRAME_SIZE (64 * 1024 * 1024) // larger declared sizes are treated as a corrupt stream
+#define RX_AHEAD_SIZE (16 * 1024) // channel's per-station read-ahead: one recv() brings in several pipelined
+                                  // frames, while a payload at least this long is read in place
+
+static inline int set_nonblocking(SOCKET s)
+{
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+    return fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+}
+
+// Frames are small and latency-bound: without this, Nagle holds a reply back until the peer's
+// delayed ACK for the previous one (tens of ms), long enough to push it into a later slot
+static inline void set_nodelay(SOCKET s)
+{
+    int on = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&on, sizeof(on));
+}
+
+// Medium access protocols. The channel, the server and the simulator all switch on the
+// strategy's flags rather than on the protocol id, so a new protocol is a new row in mac.c.
+typedef enum MacProtocol
+{
+    MAC_PURE_ALOHA,
+    MAC_SLOTTED_ALOHA,
+    MAC_CSMA,    // p-persistent
+    MAC_CSMA_CD
+} MacProtocol;
+
+typedef struct MacStrategy
+{
+    MacProtocol protocol;
+    const char *name;
+    int slotted;          // frames are grouped by fixed slot boundaries; otherwise any two frames
+                          // less than a frame time apart collide
+    int carrier_sense;    // stations defer while the medium is busy
+    int collision_detect; // a collision is signalled as soon as it happens, not at the end of the frame
+    double persistence;   // carrier sense: chance of sending in an idle slot
+} MacStrategy;
+
+// Retransmission policy after a collision. Waits are counted in slots.
+typedef enum BackoffKind
+{
+    BACKOFF_BEB,      // truncated binary exponential: uniform 0..2^min(k, cap) - 1
+    BACKOFF_JITTER,   // decorrelated jitter: uniform 1..3 * previous wait, at most cap
+    BACKOFF_ADAPTIVE  // pseudo-Bayesian: send each slot with probability 1 / estimated backlog
+} BackoffKind;
+
+typedef struct BackoffPolicy
+{
+    BackoffKind kind;
+    const char *name;
+    int cap;            // BEB: largest exponent; jitter and adaptive: longest wait in slots
+    int max_collisions; // the frame is given up on the collision after this many
+} BackoffPolicy;
+
+// Per-frame retry state
+typedef struct BackoffState
+{
+    int collisions;
+    int last_wait; // jitter: previous wait in slots
+} BackoffState;
+
+// Rivest's backlog estimate, fed with slot outcomes. Every station that hears the same
+// channel holds the same estimate, so the simulator keeps a single one.
+typedef struct BackoffEstimator
+{
+    double backlog;
+} BackoffEstimator;
 
 // Input structure for both server and channel
 typedef struct Input
@@ -20,6 +241,8 @@ typedef struct Input
     // Channel-specific
     int chan_port;
     int slot_time;
+    MacStrategy mac; // the server uses it too
+    BackoffPolicy backoff;
 
     // Server-specific
     char *chan_ip;
@@ -27,8 +250,45 @@ typedef struct Input
     int frame_size;
     int seed;
     int timeout;
+    int window; // frames kept in flight; 1 is plain stop-and-wait
+    char *hist_file; // optional latency histogram dump, NULL for none
 } Input;
 
+// Reference-counted frame so one buffer can be queued to many stations without copying. The
+// count is atomic because a sharded channel queues one frame from several threads.
+typedef struct SharedFrame
+{
+    char *buf;
+    atomic_int refs;
+    struct OutputChannel *owner; // station whose data buffer this is, handed back at the last release; NULL frees it
+    int capacity;
+} SharedFrame;
+
+// Bytes still owed to a station: an optional copied header followed by a slice of a shared frame.
+// offset counts across both parts.
+typedef struct TxItem
+{
+    char hdr[HEADER_MAX_SIZE];
+    int hdr_len;
+    SharedFrame *frame;
+    const char *data;
+    int len;
+    int offset;
+    struct TxItem *next;
+} TxItem;
+
+// One outgoing frame being fanned out. frame stays NULL until a destination can't take the
+// whole frame at once; the owner's buffer is then handed over to a SharedFrame.
+typedef struct Fanout
+{
+    const char *hdr; // header echoed ahead of the payload, NULL for bare-payload replies
+    int hdr_len;
+    const char *data;
+    int len;
+    SharedFrame *frame;
+    struct OutputChannel *owner;
+} Fanout;
+
 // Output structure for channel
 typedef struct OutputChannel
 {
@@ -39,18 +299,394 @@ typedef struct OutputChannel
     int num_packets;
     int total_collisions;
     double avg_bw;
-    DWORD start_time;
-    DWORD end_time;
+    uint64_t start_time; // now_ns()
+    uint64_t end_time;
     int send_in_slot;
-    char *data_buffer;
+    int readable; // queued on the event loop's ready list (epoll backend)
+    char rx_header[HEADER_MAX_SIZE]; // header bytes collected so far
+    int rx_header_got;
+    int rx_payload_got;          // payload bytes collected so far into data_buffer
+    int rx_corrupt;              // v2 frame whose CRC didn't match: it is answered as a collision
+    char *rx_ahead;              // bytes read past the frame being reassembled, RX_AHEAD_SIZE; NULL until needed
+    int rx_ahead_pos;            // next byte of rx_ahead to parse
+    int rx_ahead_len;
+    char *data_buffer;  // sized at the station's first frame and reused for every later one
+    int data_capacity;
+    char *spare_buffer; // a lent data buffer that came back while the station already had another
+    int spare_capacity;
+    SharedFrame *lent;  // data buffer out with replies still being sent, NULL if none
+    int lent_held;      // sharded channel: the station holds a reference on lent until it is the last
     int data_size;
+    TxItem *tx_head; // replies the socket could not take yet, oldest first
+    TxItem *tx_tail;
+    int tx_async;    // replies are only queued, for the io_uring engine to send
+    struct UringStation *uring; // io_uring engine's per-station state, NULL otherwise
     struct OutputChannel *next;
+    struct OutputChannel *prev;        // back link so a station unlinks in O(1)
+    struct OutputChannel *next_sender; // chain of stations that sent this slot, anchored at the list head
+    struct StationMetrics *metrics;    // live counters for the metrics endpoint, NULL if off
 } OutputChannel;
 
-typedef struct PrintsNode {
-    char print[256];
-    struct PrintsNode *next;
-} PrintsNode;
+// Open-addressing index from socket to station record (linear probing, power-of-two capacity)
+typedef struct StationTable
+{
+    OutputChannel **slots;
+    size_t capacity;
+    size_t count;
+} StationTable;
+
+// Fields of a v2 header (wire.c)
+typedef struct FrameHeader
+{
+    uint8_t flags;        // FRAME_DATA (maybe with FRAME_COMPACT), FRAME_NOISE or FRAME_ACK
+    uint16_t station_id;  // the sender's local port
+    uint32_t seq;         // per-station frame number
+    uint32_t payload_len; // file bytes at the front of the body, the rest is zero padding
+    uint32_t body_len;    // frame size for DATA, 0 for control frames
+    uint32_t crc;         // CRC32C of header bytes 0-17 and the body
+} FrameHeader;
+
+// Collision reply to v1 frames: the NOISE marker zero-padded to the largest frame size seen so far.
+// A reply for a smaller frame is a prefix of it, so it is only rebuilt when a larger frame shows up.
+#define NOISE_MARKER "!!!!!!!!!!!!!!!!!NOISE!!!!!!!!!!!!!!!!!"
+
+typedef struct NoiseTemplate
+{
+    SharedFrame *frame;
+    int size;
+} NoiseTemplate;
+
+// Result of draining a station's socket into its frame reassembly state
+typedef enum RxStatus
+{
+    RX_CLOSED,  // peer disconnected or the stream is unusable
+    RX_PENDING, // socket drained before a whole frame arrived
+    RX_FRAME    // a complete frame is ready for this slot
+} RxStatus;
+
+// Outcome of one slot, decided by how many stations transmitted in it
+typedef enum SlotOutcome
+{
+    SLOT_IDLE,
+    SLOT_SUCCESS,
+    SLOT_COLLISION
+} SlotOutcome;
+
+// Shared by the channel and the simulator so both resolve slots the same way
+static inline SlotOutcome classify_slot(int senders)
+{
+    if (senders == 0)
+        return SLOT_IDLE;
+    if (senders == 1)
+        return SLOT_SUCCESS;
+    return SLOT_COLLISION;
+}
+
+// Random numbers: xoshiro256** with its state held by whoever draws from it (one per station),
+// so threads never share a generator and a given seed gives the same stream on every platform.
+typedef struct Rng
+{
+    uint64_t s[4];
+} Rng;
+
+// splitmix64: expands a seed into generator state; also used to derive per-run seeds
+static inline uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Stream "stream" of seed "seed": different streams of one seed are independent
+static inline void rng_seed(Rng *rng, uint64_t seed, uint64_t stream)
+{
+    uint64_t state = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+    for (int i = 0; i < 4; i++)
+        rng->s[i] = splitmix64(&state);
+}
+
+static inline uint64_t rng_next(Rng *rng)
+{
+    uint64_t *s = rng->s;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+}
+
+// Uniform in [0, n) without modulo bias (Lemire's multiply-and-reject)
+static inline uint32_t rng_below(Rng *rng, uint32_t n)
+{
+    uint64_t m = (rng_next(rng) >> 32) * n;
+    if ((uint32_t)m < n)
+    {
+        uint32_t threshold = (uint32_t)(-n) % n;
+        while ((uint32_t)m < threshold)
+            m = (rng_next(rng) >> 32) * n;
+    }
+    return (uint32_t)(m >> 32);
+}
+
+// Uniform in (0, 1]
+static inline double rng_unit(Rng *rng)
+{
+    return (double)((rng_next(rng) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+// Binary exponential backoff: after the k-th collision wait a uniform 0..2^k - 1 slots
+static inline int backoff_slots(int k, Rng *rng)
+{
+    return (int)rng_below(rng, 1u << k);
+}
+
+// Slot k covers [origin + k * slot_time, origin + (k + 1) * slot_time), so boundaries never drift
+typedef struct SlotClock
+{
+    uint64_t origin; // all times in nanoseconds
+    uint64_t slot_time;
+    uint64_t slot_end;
+    uint64_t slot_index;
+} SlotClock;
+
+// Live counters behind the channel's metrics endpoint (metrics.c). Every counter has a single
+// writer, the thread that owns the station or resolves the slots, and is read without locks.
+typedef enum MetricsCellState
+{
+    METRICS_FREE,
+    METRICS_FILLING, // claimed, labels being written
+    METRICS_LIVE
+} MetricsCellState;
+
+typedef struct StationMetrics
+{
+    atomic_int state;
+    atomic_uint seq; // odd while the labels are being written; a reader that saw it change discards its copy
+    char address[16];
+    int port;
+    uint64_t start_time;
+    atomic_int frame_size;
+    _Atomic uint64_t frames;
+    _Atomic uint64_t collisions;
+} StationMetrics;
+
+typedef struct ChannelMetrics
+{
+    uint64_t origin; // now_ns() at start, for the number of elapsed slots
+    uint64_t slot_time;
+    _Atomic uint64_t success_slots;
+    _Atomic uint64_t collision_slots;
+    _Atomic uint64_t transmissions;
+    StationMetrics stations[MAX_SERVERS];
+    SOCKET listener;
+    thread_t thread;
+    atomic_int closing;
+} ChannelMetrics;
+
+// Per-station statistics, logged when a station leaves or the channel stops (log.c)
+typedef struct LogRecord
+{
+    char address[16]; // dotted IPv4
+    int port;
+    int frames;
+    int collisions;
+    double avg_bw; // Mbps
+} LogRecord;
+
+#define LOG_QUEUE_SIZE 4096 // records on their way to the writer, a power of two
+
+typedef struct LogCell
+{
+    atomic_size_t seq; // cell's turn: equals the position a producer may fill, +1 once filled
+    LogRecord record;
+} LogCell;
+
+// Bounded multi-producer, single-consumer ring drained by a writer thread
+typedef struct LogQueue
+{
+    LogCell *cells;
+    size_t mask;
+    atomic_size_t enqueue_pos; // shared by the producers
+    char pad[64];              // keeps the writer's position off the producers' cache line
+    size_t dequeue_pos;        // the writer's alone
+    atomic_size_t dropped;
+    atomic_int closing;
+    FILE *out;
+    thread_t writer;
+} LogQueue;
+
+#ifdef __linux__
+// Sharded channel (shard.c): stations are spread over worker threads, each running its own
+// epoll loop over its own stations. At every slot end the shards meet at a barrier that sums
+// their sender counts into one decision, and each then sends the outcome to its own stations.
+// Per-slot state is kept twice, by slot parity: a shard that has passed a barrier can already
+// fill in the next slot while a slower one is still reading the last.
+typedef struct SlotBarrier
+{
+    atomic_int waiting;
+    atomic_uint generation; // bumped by the last shard to arrive, which releases the others
+    int parties;
+} SlotBarrier;
+
+// A shard with exactly one sender puts its frame up in case it was the slot's only sender
+typedef struct SlotCandidate
+{
+    SharedFrame *frame; // the sender's buffer, with one reference per shard
+    char hdr[HEADER_MAX_SIZE];
+    int hdr_len; // 0 for a bare-payload reply
+    int len;
+    int corrupt; // the shard's only sender failed its CRC; no frame is put up then
+} SlotCandidate;
+
+typedef struct PendingStation
+{
+    SOCKET socket;
+    struct sockaddr_in addr;
+} PendingStation;
+
+typedef struct ChannelShard
+{
+    struct ShardedChannel *channel;
+    int index;
+    thread_t thread;
+    int epfd;
+    int wake_fd; // eventfd: a station handed over, an early slot end, or stop
+    OutputChannel *head;
+    OutputChannel *current;
+    StationTable table;
+    NoiseTemplate noise;
+    mutex_t inbox_lock; // accepted connections not yet picked up by the shard
+    PendingStation *inbox;
+    int inbox_count;
+    int inbox_cap;
+    int published;     // this slot's senders already added to the shared count
+    int senders[2];    // this shard's senders at the barrier, by slot parity
+    SlotCandidate candidate[2];
+} ChannelShard;
+
+typedef struct ShardedChannel
+{
+    const MacStrategy *mac;
+    SlotClock clock;                // advanced only by the last shard to reach the barrier
+    _Atomic uint64_t slot_end;      // moved by any shard under pure ALOHA and collision detection
+    atomic_int senders[2];          // frames received in the slot, over all shards, by slot parity
+    atomic_int stopping;
+    SlotBarrier barrier;
+    int num_shards;
+    ChannelShard *shards;
+    LogQueue *log;
+} ShardedChannel;
+#endif
+
+// Station input file. Memory-mapped when possible so frames go out straight from the mapping;
+// otherwise frames are fread() into a caller-supplied scratch buffer. A synthetic source makes up
+// frames of random bytes instead of reading a file.
+typedef struct InputSource
+{
+    FILE *f;
+    const char *map;
+    size_t size;
+    size_t offset;
+    uint64_t synthetic_left; // frames still to generate
+    Rng pattern;
+#ifdef _WIN32
+    HANDLE file_handle;
+    HANDLE map_handle;
+#endif
+} InputSource;
+
+// One frame of a windowed station's sending window
+typedef struct WindowSlot
+{
+    char header[HEADER_V2_SIZE];
+    char *scratch;       // payload storage when the input isn't mapped
+    const char *payload; // file bytes of this frame, zero-padded up to frame_size on the wire
+    int payload_len;
+    uint32_t seq;
+    int in_use;
+    int in_flight; // sent, waiting for its echo or NOISE
+    int transmissions;
+    BackoffState backoff;
+    uint64_t first_sent_at; // now_ns()
+    uint64_t sent_at;
+    uint64_t backoff_from;  // when the current backoff started
+    uint64_t retry_at;      // backoff expiry while not in flight
+    uint64_t backoff_ns;    // backoff time accumulated so far
+} WindowSlot;
+
+// Timer wheel (timer.c): WHEEL_LEVELS levels of WHEEL_SIZE slots. With 1 ms ticks it spans
+// about 4.6 hours; later timers are parked in the last slot until they come into range.
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+typedef struct Timer
+{
+    uint64_t expires; // in ticks
+    struct Timer *next;
+    struct Timer *prev;
+    int level;
+    int slot;
+    int pending; // armed and not yet fired
+    void *owner;
+} Timer;
+
+typedef struct TimerWheel
+{
+    uint64_t origin;  // now_ns() at tick 0
+    uint64_t tick_ns;
+    uint64_t now;     // next tick to expire
+    uint64_t occupied[WHEEL_LEVELS]; // one bit per non-empty slot
+    Timer *slots[WHEEL_LEVELS][WHEEL_SIZE];
+    size_t count;
+} TimerWheel;
+
+// Latency histogram in nanoseconds (stats.c). Buckets keep HIST_SUB_BITS significant bits.
+#define HIST_SUB_BITS 7
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (HIST_SUB_BUCKETS + (64 - HIST_SUB_BITS) * (HIST_SUB_BUCKETS / 2))
+
+typedef struct LatencyHistogram
+{
+    const char *name;
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} LatencyHistogram;
+
+// Discrete-event simulation of the slotted channel (sim.c). Time is counted in slots and
+// idle stretches are skipped, so no real sockets, sleeps or timeouts are involved.
+typedef struct SimConfig
+{
+    int stations;
+    double load;        // new frames offered per slot, summed over all stations
+    uint64_t slots;     // length of the run
+    uint64_t seed;
+    int slot_time;      // ms, only used to express delays as time
+    BackoffPolicy backoff;
+    MacStrategy mac;
+    int frame_ticks;    // frame time in units of the propagation delay, the carrier-sense granularity
+} SimConfig;
+
+typedef struct SimResult
+{
+    uint64_t slots;
+    uint64_t idle_slots;
+    uint64_t success_slots;   // delivered frames
+    uint64_t collision_slots; // busy periods that ended in a collision
+    uint64_t attempts; // transmissions, retries included
+    uint64_t dropped;  // frames abandoned after max_collisions
+    double throughput;   // S: delivered frames per frame time
+    double offered_load; // G: transmissions per frame time
+    LatencyHistogram frame_delay; // first transmission to success, in virtual time
+} SimResult;
 
 // Output structure for server
 typedef struct OutputServer
@@ -63,18 +699,178 @@ typedef struct OutputServer
     int max_transmissions;
     double avg_transmissions;
     double avg_bw;
+    LatencyHistogram echo_latency;  // last transmission to its echo
+    LatencyHistogram frame_latency; // first transmission to the echo, retries included
+    LatencyHistogram backoff_wait;  // time spent backing off, per frame
 } OutputServer;
 
+// Stop-and-wait station driven by events instead of blocking calls (station.c). Each state
+// waits on the station's one timer and, while a frame is out, on its socket.
+typedef enum StationState
+{
+    STATION_BACKOFF,    // timer: end of the backoff before the next transmission
+    STATION_SENSING,    // timer: next carrier-sense look
+    STATION_AWAIT_ECHO, // socket: echo or NOISE; timer: the echo timeout
+    STATION_DONE
+} StationState;
+
+typedef struct Station
+{
+    SOCKET socket;
+    StationState state;
+    Timer timer;
+    const Input *cfg; // frame size, slot time, timeout, MAC and backoff policy
+    InputSource *in;
+    OutputServer *out;     // this station's result
+    OutputServer *latency; // where its latency samples go; may be shared between stations
+    int verbose;           // print per-frame progress
+    Rng rng;
+    BackoffEstimator est;
+    BackoffState backoff;
+    char header[HEADER_V2_SIZE];
+    uint16_t station_id; // local port, echoed back in ACK and NOISE frames
+    uint32_t seq;        // sequence number of the current frame
+    const char *padding; // frame_size zero bytes, shared between stations
+    char *scratch;       // payload storage when the input isn't mapped
+    const char *payload;
+    int payload_len;
+    char rx_header[HEADER_V2_SIZE]; // reply header being reassembled
+    int rx_header_got;
+    char *rx;         // sink for the bodies of other stations' frames, frame_size bytes
+    int rx_body_left; // body bytes of the current reply still to be read
+    int heard; // carrier sense: the channel forwarded traffic since the last look
+    int transmissions;
+    uint64_t first_sent_at; // now_ns()
+    uint64_t sent_at;
+    uint64_t backoff_from;
+    uint64_t backoff_ns;
+    uint64_t done_at;
+    int total_transmissions;
+    int num_frames;
+} Station;
+
+// One thread's worth of stations sharing a timer wheel and a readiness set
+typedef struct StationLoop
+{
+    TimerWheel wheel;
+    int active;
+#ifdef __linux__
+    int epfd;
+#endif
+} StationLoop;
+
 // Channel-side functions
 void free_list_1(OutputChannel *head);
-void free_list_2(PrintsNode *head);
 void reset_all_send_flags(OutputChannel *head);
+void log_server_stats(OutputChannel *ptr, LogQueue *log);
+int count_active(OutputChannel *head);
+OutputChannel *accept_server(SOCKET tcp_s, OutputChannel **current);
+OutputChannel *add_station(SOCKET new_server, const struct sockaddr_in *addr, OutputChannel **current);
+int index_station(StationTable *table, OutputChannel **current, OutputChannel *station);
+RxStatus receive_frame(OutputChannel *head, OutputChannel *ptr);
+int rx_buffered(const OutputChannel *ptr);
+int rx_direct_want(OutputChannel *ptr, char **dst);
+RxStatus rx_advance(OutputChannel *head, OutputChannel *ptr, int received);
+RxStatus rx_parse(OutputChannel *head, OutputChannel *ptr);
+SharedFrame *shared_frame_wrap(char *buf);
+void shared_frame_release(SharedFrame *frame);
+void station_reclaim(OutputChannel *ptr);
+int station_send(OutputChannel *dst, Fanout *fan);
+int flush_tx(OutputChannel *ptr);
+int tx_gather(const OutputChannel *ptr, const char **bufs, int *lens, long *total);
+void tx_advance(OutputChannel *ptr, long written);
+void clear_tx(OutputChannel *ptr);
+void disconnect_server(OutputChannel *head, OutputChannel **current, StationTable *table, OutputChannel *ptr, LogQueue *log);
+void detach_server(OutputChannel *head, OutputChannel **current, StationTable *table, OutputChannel *ptr, LogQueue *log);
+void free_server(OutputChannel *ptr);
+int station_table_init(StationTable *table, size_t capacity);
+void station_table_free(StationTable *table);
+OutputChannel *station_table_find(const StationTable *table, SOCKET socket);
+int station_table_insert(StationTable *table, OutputChannel *station);
+void station_table_remove(StationTable *table, SOCKET socket);
+SlotOutcome settle_slot(int senders, int lone_corrupt);
+SlotOutcome resolve_slot(OutputChannel *head, NoiseTemplate *noise);
+SharedFrame *noise_frame(NoiseTemplate *noise, int frame_size);
+int reply_header_len(const OutputChannel *ptr);
+void slot_clock_init(SlotClock *clock, int slot_time);
+uint64_t slot_clock_remaining(const SlotClock *clock);
+void slot_clock_advance(SlotClock *clock);
+void slot_clock_restart(SlotClock *clock, uint64_t delay_ns);
+void update_slot_end(const MacStrategy *mac, SlotClock *clock, OutputChannel *head, int *senders_seen);
+void deliver_slot(OutputChannel *head, NoiseTemplate *noise, SlotOutcome outcome, Fanout *winner);
+#ifdef __linux__
+int run_sharded(SOCKET tcp_s, const Input *c1, int num_shards, LogQueue *log);
+int run_uring(SOCKET tcp_s, const Input *c1, LogQueue *log);
+#endif
+#ifdef _WIN32
 DWORD WINAPI monitor_ctrl_z(LPVOID param);
-void print_logs(PrintsNode *head);
-void log_server_stats(OutputChannel *ptr, PrintsNode **currPrints);
+#endif
 
 // Server-side functions
-void exponential_backoff(int k, int slot_time);
+extern volatile int stop_flag; // set on Ctrl+C
+void build_header(char *packet, int frame_size, uint16_t ethertype, uint16_t station_id, uint32_t seq);
+int recv_all(SOCKET sockfd, char *buf, int len);
+int send_frame(SOCKET sockfd, const char *header, int header_len, const char *payload, int payload_len, int frame_size, const char *padding);
+int input_open(InputSource *in, const char *file_name);
+const char *input_next_frame(InputSource *in, char *scratch, int frame_size, int *payload_len);
+void input_close(InputSource *in);
+void input_slice(InputSource *in, const InputSource *whole, size_t start, size_t len);
+void input_synthetic(InputSource *in, uint64_t frames, uint64_t seed, uint64_t stream);
+void print_summary(OutputServer *out, const char *name, int frame_size, int num_frames, int total_transmissions, uint64_t elapsed_ns);
+void send_file_windowed(SOCKET sockfd, InputSource *in, Input *s1, OutputServer *out, Rng *rng, BackoffEstimator *est, int *total_transmissions, int *num_frames);
+#ifdef _WIN32
 BOOL WINAPI ctrl_handler(DWORD ctrl_type);
+#endif
+
+// Wire format v2
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+void build_header_v2(char *packet, uint8_t flags, uint16_t station_id, uint32_t seq, uint32_t payload_len, uint32_t body_len);
+uint32_t frame_crc(const char *header, const char *payload, int payload_len, const char *padding, int padding_len);
+void header_v2_seal(char *packet, uint32_t crc);
+int header_v2_parse(const char *packet, FrameHeader *fh);
+
+// Metrics endpoint
+int metrics_start(int port, int slot_time);
+void metrics_stop(void);
+StationMetrics *metrics_station_open(const char *address, int port);
+void metrics_station_close(StationMetrics *m);
+void metrics_slot(SlotOutcome outcome, int senders);
+
+// Log queue
+int log_queue_start(LogQueue *q, FILE *out);
+int log_queue_push(LogQueue *q, const LogRecord *record);
+void log_queue_stop(LogQueue *q);
+
+// Timer wheel
+void timer_wheel_init(TimerWheel *wheel, uint64_t origin_ns, uint64_t tick_ns);
+void timer_schedule(TimerWheel *wheel, Timer *timer, uint64_t when_ns);
+void timer_cancel(TimerWheel *wheel, Timer *timer);
+Timer *timer_wheel_expire(TimerWheel *wheel, uint64_t now_ns);
+uint64_t timer_wheel_next(const TimerWheel *wheel);
+
+// Event-driven stations
+int station_init(Station *st, SOCKET socket, InputSource *in, const Input *cfg, OutputServer *out, const char *padding, uint64_t stream);
+void station_free(Station *st);
+int station_loop_run(Station *stations, int count);
+
+// Latency statistics
+void histogram_init(LatencyHistogram *hist, const char *name);
+void histogram_record(LatencyHistogram *hist, uint64_t value_ns);
+uint64_t histogram_percentile(const LatencyHistogram *hist, double percentile);
+void histogram_print(const LatencyHistogram *hist);
+void histogram_dump(const LatencyHistogram *hist, FILE *f);
+
+// MAC strategies
+int mac_parse(const char *spec, MacStrategy *mac);
+int mac_transmit_now(const MacStrategy *mac, int medium_busy, Rng *rng);
+int backoff_parse(const char *spec, BackoffPolicy *policy);
+int backoff_first(const BackoffPolicy *policy, const BackoffEstimator *est, Rng *rng);
+int backoff_next(const BackoffPolicy *policy, BackoffState *state, const BackoffEstimator *est, Rng *rng);
+void backoff_done(BackoffState *state);
+void backoff_estimator_init(BackoffEstimator *est);
+void backoff_observe(BackoffEstimator *est, SlotOutcome outcome, uint64_t slots);
+
+// Simulator
+int simulate(const SimConfig *cfg, SimResult *res);
 
 #endif // NETWORK_SIM_H
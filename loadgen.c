@@ -0,0 +1,228 @@
+#include "header.h"
+
+// Many stations from one process: each gets its own connection, input, backoff stream and
+// estimator, and all of them run on one station loop.
+
+volatile int stop_flag = 0; // Shared flag to signal stop
+
+#ifndef _WIN32
+static void handle_stop_signal(int sig)
+{
+    (void)sig;
+    stop_flag = 1;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    if (argc < 9 || argc > 12)
+    {
+        fprintf(stderr, "Usage: %s <chan_ip> <chan_port> <file_name|-> <frame_size> <slot_time> <seed> <timeout> <stations> [frames] [mac] [backoff]\n", argv[0]);
+        return 1;
+    }
+    Input cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.chan_ip = argv[1];
+    cfg.chan_port = atoi(argv[2]);
+    cfg.file_name = strcmp(argv[3], "-") != 0 ? argv[3] : NULL;
+    cfg.frame_size = atoi(argv[4]);
+    cfg.slot_time = atoi(argv[5]);
+    cfg.seed = atoi(argv[6]);
+    cfg.timeout = atoi(argv[7]);
+    cfg.window = 1;
+    int count = atoi(argv[8]);
+    uint64_t frames = argc >= 10 ? strtoull(argv[9], NULL, 10) : 100;
+    if (!mac_parse(argc >= 11 ? argv[10] : "slotted", &cfg.mac))
+    {
+        fprintf(stderr, "Unknown MAC protocol: %s\n", argv[10]);
+        return 1;
+    }
+    if (!backoff_parse(argc == 12 ? argv[11] : "beb", &cfg.backoff))
+    {
+        fprintf(stderr, "Unknown backoff policy: %s\n", argv[11]);
+        return 1;
+    }
+    if (count < 1 || count > MAX_SERVERS || cfg.frame_size < 1)
+    {
+        fprintf(stderr, "stations must be between 1 and %d and frame_size positive\n", MAX_SERVERS);
+        return 1;
+    }
+
+    // A file is split between the stations at frame boundaries, so it has to be mapped
+    InputSource whole;
+    memset(&whole, 0, sizeof(whole));
+    if (cfg.file_name && (!input_open(&whole, cfg.file_name) || !whole.map))
+    {
+        fprintf(stderr, "Failed to map file: %s\n", cfg.file_name);
+        input_close(&whole);
+        return 1;
+    }
+
+    Station *stations = (Station *)calloc(count, sizeof(Station));
+    InputSource *inputs = (InputSource *)calloc(count, sizeof(InputSource));
+    OutputServer *results = (OutputServer *)calloc(count, sizeof(OutputServer));
+    OutputServer *latency = (OutputServer *)malloc(sizeof(OutputServer));
+    char (*names)[64] = (char (*)[64])calloc(count, 64);
+    char *padding = (char *)calloc(cfg.frame_size + 1, 1);
+    if (!stations || !inputs || !results || !latency || !names || !padding)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(stations);
+        free(inputs);
+        free(results);
+        free(latency);
+        free(names);
+        free(padding);
+        input_close(&whole);
+        return 1;
+    }
+    // Latency percentiles are kept for all stations together: a histogram per station would
+    // cost more memory than the station itself
+    memset(latency, 0, sizeof(OutputServer));
+    histogram_init(&latency->echo_latency, "Echo latency");
+    histogram_init(&latency->frame_latency, "Frame latency");
+    histogram_init(&latency->backoff_wait, "Backoff wait");
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (iResult != NO_ERROR)
+    {
+        fprintf(stderr, "Error at WSAStartup(): %d\n", iResult);
+        free(stations);
+        free(inputs);
+        free(results);
+        free(latency);
+        free(names);
+        free(padding);
+        input_close(&whole);
+        return 1;
+    }
+    SetConsoleCtrlHandler(ctrl_handler, TRUE);
+#else
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(cfg.chan_port);
+    server_addr.sin_addr.s_addr = inet_addr(cfg.chan_ip);
+#ifdef _WIN32
+    int timeout_ms = cfg.timeout * 1000;
+#else
+    struct timeval timeout_ms = {cfg.timeout, 0};
+#endif
+
+    size_t total_frames = cfg.file_name ? (whole.size + cfg.frame_size - 1) / cfg.frame_size : 0;
+    int connected = 0;
+    int ok = 1;
+    for (int i = 0; i < count && ok; i++)
+    {
+        if (cfg.file_name)
+        {
+            size_t first = total_frames * i / count;
+            size_t last = total_frames * (i + 1) / count;
+            size_t start = first * cfg.frame_size;
+            size_t end = last * cfg.frame_size < whole.size ? last * cfg.frame_size : whole.size;
+            input_slice(&inputs[i], &whole, start, end - start);
+            snprintf(names[i], 64, "%s, station %d", cfg.file_name, i);
+        }
+        else
+        {
+            input_synthetic(&inputs[i], frames, (uint64_t)cfg.seed, (uint64_t)i);
+            snprintf(names[i], 64, "synthetic, station %d", i);
+        }
+
+        SOCKET sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd == INVALID_SOCKET)
+        {
+            fprintf(stderr, "Socket creation failed for station %d: %d\n", i, WSAGetLastError());
+            ok = 0;
+            break;
+        }
+        if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == SOCKET_ERROR)
+        {
+            fprintf(stderr, "Connection failed for station %d: %d\n", i, WSAGetLastError());
+            closesocket(sockfd);
+            ok = 0;
+            break;
+        }
+        set_nodelay(sockfd);
+        // A stalled channel fails the send instead of holding up every station on the loop
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout_ms, sizeof(timeout_ms));
+
+        results[i].success = 1;
+        if (!station_init(&stations[i], sockfd, &inputs[i], &cfg, &results[i], padding, (uint64_t)i))
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            station_free(&stations[i]);
+            closesocket(sockfd);
+            ok = 0;
+            break;
+        }
+        stations[i].latency = latency;
+        stations[i].verbose = 0;
+        connected++;
+    }
+
+    uint64_t start_time = now_ns();
+    if (ok)
+    {
+        fprintf(stderr, "%d stations connected, sending...\n", count);
+        ok = station_loop_run(stations, count);
+    }
+
+    int total_frames_sent = 0;
+    int total_transmissions = 0;
+    int succeeded = 0;
+    if (ok)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            Station *st = &stations[i];
+            uint64_t end = st->state == STATION_DONE ? st->done_at : now_ns();
+            print_summary(&results[i], names[i], cfg.frame_size, st->num_frames, st->total_transmissions, end - start_time);
+            total_frames_sent += st->num_frames;
+            total_transmissions += st->total_transmissions;
+            if (results[i].success && st->state == STATION_DONE)
+                succeeded++;
+            if (results[i].max_transmissions > latency->max_transmissions)
+                latency->max_transmissions = results[i].max_transmissions;
+        }
+
+        // All stations together, in the same format
+        char all_name[64];
+        snprintf(all_name, sizeof(all_name), "%s, all %d stations (%d succeeded)", cfg.file_name ? cfg.file_name : "synthetic",
+                 count, succeeded);
+        latency->success = succeeded == count;
+        print_summary(latency, all_name, cfg.frame_size, total_frames_sent, total_transmissions, now_ns() - start_time);
+        histogram_print(&latency->echo_latency);
+        histogram_print(&latency->frame_latency);
+        histogram_print(&latency->backoff_wait);
+        fprintf(stderr, "\n");
+    }
+
+    for (int i = 0; i < connected; i++)
+    {
+        closesocket(stations[i].socket);
+        station_free(&stations[i]);
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    input_close(&whole);
+    free(stations);
+    free(inputs);
+    free(results);
+    free(names);
+    free(padding);
+    int all_ok = ok && latency->success;
+    free(latency);
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+#include "header.h"
+
+// Station statistics on their way out. Producers (the channel loop, or every shard) claim a cell
+// of a bounded ring with one compare-and-swap and publish it through the cell's sequence number,
+// in the manner of Vyukov's bounded queue. A writer thread formats the records and streams them
+// to the log file. A producer never waits: with the ring full the record is dropped and counted.
+
+#define LOG_IDLE_MS 10 // writer's nap when the ring is empty
+
+static int log_queue_pop(LogQueue *q, LogRecord *record)
+{
+    LogCell *cell = &q->cells[q->dequeue_pos & q->mask];
+    if (atomic_load_explicit(&cell->seq, memory_order_acquire) != q->dequeue_pos + 1)
+        return 0; // empty, or the next producer has not finished writing its record
+    *record = cell->record;
+    atomic_store_explicit(&cell->seq, q->dequeue_pos + q->mask + 1, memory_order_release);
+    q->dequeue_pos++;
+    return 1;
+}
+
+static thread_ret_t THREAD_CALL log_writer(void *arg)
+{
+    LogQueue *q = (LogQueue *)arg;
+    LogRecord record;
+    while (1)
+    {
+        int closing = atomic_load(&q->closing); // read first: records pushed before close are drained
+        int written = 0;
+        while (log_queue_pop(q, &record))
+        {
+            fprintf(q->out, "From %s port %d: %d frames, %d collisions, average bandwidth: %.3f Mbps\n",
+                    record.address, record.port, record.frames, record.collisions, record.avg_bw);
+            written++;
+        }
+        if (written)
+            fflush(q->out);
+        if (closing)
+            break;
+        Sleep(LOG_IDLE_MS);
+    }
+    return 0;
+}
+
+// Start the writer on "out", which stays open until log_queue_stop(). Returns 0 on failure.
+int log_queue_start(LogQueue *q, FILE *out)
+{
+    memset(q, 0, sizeof(LogQueue));
+    q->cells = (LogCell *)malloc(LOG_QUEUE_SIZE * sizeof(LogCell));
+    if (!q->cells)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    for (size_t i = 0; i < LOG_QUEUE_SIZE; i++)
+        atomic_init(&q->cells[i].seq, i);
+    q->mask = LOG_QUEUE_SIZE - 1;
+    q->out = out;
+    if (!thread_start(&q->writer, log_writer, q))
+    {
+        fprintf(stderr, "Failed to start the log writer\n");
+        free(q->cells);
+        q->cells = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+// Queue a record from any thread. Returns 0 if the ring was full and the record was dropped.
+int log_queue_push(LogQueue *q, const LogRecord *record)
+{
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    LogCell *cell;
+    while (1)
+    {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            atomic_fetch_add(&q->dropped, 1);
+            return 0;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    cell->record = *record;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return 1;
+}
+
+// Drain what is queued, stop the writer and report drops. Call once every producer is done.
+void log_queue_stop(LogQueue *q)
+{
+    if (!q->cells)
+        return;
+    atomic_store(&q->closing, 1);
+    thread_join(q->writer);
+    size_t dropped = atomic_load(&q->dropped);
+    if (dropped)
+        fprintf(stderr, "%lu log records dropped: the writer fell behind\n", (unsigned long)dropped);
+    free(q->cells);
+    q->cells = NULL;
+}
@@ -0,0 +1,156 @@
+#include "header.h"
+
+// Selectable protocols. CSMA contends in sensing slots rather than frame slots, so the channel
+// groups its frames per slot, as it does for slotted ALOHA.
+static const MacStrategy strategies[] = {
+    {MAC_PURE_ALOHA, "pure", 0, 0, 0, 1.0},
+    {MAC_SLOTTED_ALOHA, "slotted", 1, 0, 0, 1.0},
+    {MAC_CSMA, "csma", 1, 1, 0, 0.5},
+    {MAC_CSMA_CD, "csma-cd", 1, 1, 1, 0.5},
+};
+
+// Look up "name" or "name:p", p overriding the persistence of the carrier-sense protocols.
+// Returns 0 for an unknown name or a p outside (0, 1].
+int mac_parse(const char *spec, MacStrategy *mac)
+{
+    const char *colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++)
+    {
+        if (strlen(strategies[i].name) != len || strncmp(strategies[i].name, spec, len) != 0)
+            continue;
+        *mac = strategies[i];
+        if (colon)
+        {
+            char *end;
+            double p = strtod(colon + 1, &end);
+            if (!mac->carrier_sense || end == colon + 1 || *end || p <= 0.0 || p > 1.0)
+                return 0;
+            mac->persistence = p;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// Station side: may a ready frame go out in this slot? ALOHA always sends; carrier sense
+// defers while the medium is busy and otherwise sends with the persistence probability.
+int mac_transmit_now(const MacStrategy *mac, int medium_busy, Rng *rng)
+{
+    if (!mac->carrier_sense)
+        return 1;
+    if (medium_busy)
+        return 0;
+    return mac->persistence >= 1.0 || rng_unit(rng) <= mac->persistence;
+}
+
+// Rivest's pseudo-Bayesian estimator assumes arrivals at the rate it steers for, 1/e
+#define BACKOFF_LAMBDA 0.36787944117144233
+#define BACKOFF_COLLISION_STEP (BACKOFF_LAMBDA + 1.0 / (2.718281828459045 - 2.0))
+
+static const BackoffPolicy policies[] = {
+    {BACKOFF_BEB, "beb", 10, 10},
+    {BACKOFF_JITTER, "jitter", 1024, 10},
+    {BACKOFF_ADAPTIVE, "adaptive", 1 << 20, 10},
+};
+
+// Look up "name", "name:cap" or "name:cap:max_collisions". Returns 0 for an unknown name or
+// a value out of range.
+int backoff_parse(const char *spec, BackoffPolicy *policy)
+{
+    const char *colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+    {
+        if (strlen(policies[i].name) != len || strncmp(policies[i].name, spec, len) != 0)
+            continue;
+        *policy = policies[i];
+        if (colon)
+        {
+            char *end;
+            long cap = strtol(colon + 1, &end, 10);
+            if (end == colon + 1 || cap < 1 || cap > (policy->kind == BACKOFF_BEB ? 30 : 1 << 30))
+                return 0;
+            policy->cap = (int)cap;
+            if (*end == ':')
+            {
+                const char *max = end + 1;
+                long max_collisions = strtol(max, &end, 10);
+                if (end == max || max_collisions < 0)
+                    return 0;
+                policy->max_collisions = (int)max_collisions;
+            }
+            if (*end)
+                return 0;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// Each slot is a send with probability 1 / backlog: count the slots until one is
+static int adaptive_wait(const BackoffPolicy *policy, const BackoffEstimator *est, Rng *rng)
+{
+    double q = est->backlog > 1.0 ? 1.0 / est->backlog : 1.0;
+    int wait = 0;
+    while (wait < policy->cap && rng_unit(rng) > q)
+        wait++;
+    return wait;
+}
+
+// Slots a new frame waits before its first transmission. Only the adaptive policy holds new
+// frames back: the estimator controls every transmission, not just retries.
+int backoff_first(const BackoffPolicy *policy, const BackoffEstimator *est, Rng *rng)
+{
+    return policy->kind == BACKOFF_ADAPTIVE ? adaptive_wait(policy, est, rng) : 0;
+}
+
+// Slots to wait after a collision, or -1 once the frame has used up its collisions
+int backoff_next(const BackoffPolicy *policy, BackoffState *state, const BackoffEstimator *est, Rng *rng)
+{
+    if (state->collisions >= policy->max_collisions)
+        return -1;
+    state->collisions++;
+    switch (policy->kind)
+    {
+    case BACKOFF_JITTER:
+    {
+        int prev = state->last_wait > 0 ? state->last_wait : 1;
+        uint32_t range = prev < policy->cap / 3 ? (uint32_t)prev * 3 : (uint32_t)policy->cap;
+        state->last_wait = 1 + (int)rng_below(rng, range);
+        if (state->last_wait > policy->cap)
+            state->last_wait = policy->cap;
+        return state->last_wait;
+    }
+    case BACKOFF_ADAPTIVE:
+        return adaptive_wait(policy, est, rng);
+    case BACKOFF_BEB:
+    default:
+        return backoff_slots(state->collisions < policy->cap ? state->collisions : policy->cap, rng);
+    }
+}
+
+// The frame went through or was given up; the next one starts afresh
+void backoff_done(BackoffState *state)
+{
+    state->collisions = 0;
+    state->last_wait = 0;
+}
+
+void backoff_estimator_init(BackoffEstimator *est)
+{
+    est->backlog = 1.0;
+}
+
+// Feed "slots" slots with the given outcome into the backlog estimate
+void backoff_observe(BackoffEstimator *est, SlotOutcome outcome, uint64_t slots)
+{
+    if (outcome == SLOT_COLLISION)
+    {
+        est->backlog += (double)slots * BACKOFF_COLLISION_STEP;
+        return;
+    }
+    est->backlog -= (double)slots * (1.0 - BACKOFF_LAMBDA);
+    if (est->backlog < BACKOFF_LAMBDA)
+        est->backlog = BACKOFF_LAMBDA;
+}
@@ -0,0 +1,306 @@
+#include "header.h"
+#include <stdarg.h>
+
+// Live channel metrics in the Prometheus text format, served over HTTP on a local port by a
+// thread of their own. The slot loop only stores into counters it alone writes: per-station
+// cells claimed when a station connects, and the slot outcome totals. It never takes a lock or
+// waits for a reader. A scrape reads the counters while they move, so figures from one scrape
+// can be a slot apart.
+//
+// Idle slots are not counted by the loop: they are whatever part of the elapsed slots was
+// neither a success nor a collision. Under pure ALOHA a "slot" is one frame time.
+
+#define METRICS_POLL_MS 100 // how often the server looks for a stop request while no scraper is connected
+
+static ChannelMetrics *active; // NULL while metrics are off
+
+// Single-writer counter: a plain load and store, no locked read-modify-write
+static void counter_add(_Atomic uint64_t *counter, uint64_t n)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Claim a cell for a newly connected station, or NULL with metrics off or all cells taken
+StationMetrics *metrics_station_open(const char *address, int port)
+{
+    if (!active)
+        return NULL;
+    for (int i = 0; i < MAX_SERVERS; i++)
+    {
+        StationMetrics *m = &active->stations[i];
+        int expected = METRICS_FREE;
+        if (!atomic_compare_exchange_strong(&m->state, &expected, METRICS_FILLING))
+            continue;
+        // A scrape may still be copying the previous station's labels out of this cell
+        atomic_fetch_add_explicit(&m->seq, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        snprintf(m->address, sizeof(m->address), "%s", address);
+        m->port = port;
+        m->start_time = now_ns();
+        atomic_store_explicit(&m->frame_size, 0, memory_order_relaxed);
+        atomic_store_explicit(&m->frames, 0, memory_order_relaxed);
+        atomic_store_explicit(&m->collisions, 0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&m->seq, 1, memory_order_release);
+        atomic_store_explicit(&m->state, METRICS_LIVE, memory_order_release);
+        return m;
+    }
+    return NULL;
+}
+
+void metrics_station_close(StationMetrics *m)
+{
+    if (m)
+        atomic_store_explicit(&m->state, METRICS_FREE, memory_order_release);
+}
+
+// Count one resolved slot. Called by one thread only: the channel loop, or the first shard.
+void metrics_slot(SlotOutcome outcome, int senders)
+{
+    if (!active || outcome == SLOT_IDLE)
+        return;
+    counter_add(outcome == SLOT_SUCCESS ? &active->success_slots : &active->collision_slots, 1);
+    counter_add(&active->transmissions, (uint64_t)senders);
+}
+
+// One station's cell as the renderer copied it
+typedef struct StationSnapshot
+{
+    char address[16];
+    int port;
+    uint64_t start_time;
+    int frame_size;
+    uint64_t frames;
+    uint64_t collisions;
+} StationSnapshot;
+
+// Copy a live cell. Returns 0 if it isn't live, or was closed or reused while being copied.
+static int station_snapshot(StationMetrics *m, StationSnapshot *out)
+{
+    unsigned seq = atomic_load_explicit(&m->seq, memory_order_acquire);
+    if ((seq & 1) || atomic_load_explicit(&m->state, memory_order_acquire) != METRICS_LIVE)
+        return 0;
+    memcpy(out->address, m->address, sizeof(out->address));
+    out->address[sizeof(out->address) - 1] = '\0';
+    out->port = m->port;
+    out->start_time = m->start_time;
+    out->frame_size = atomic_load_explicit(&m->frame_size, memory_order_relaxed);
+    out->frames = atomic_load_explicit(&m->frames, memory_order_relaxed);
+    out->collisions = atomic_load_explicit(&m->collisions, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&m->seq, memory_order_relaxed) == seq &&
+           atomic_load_explicit(&m->state, memory_order_relaxed) == METRICS_LIVE;
+}
+
+typedef struct TextBuffer
+{
+    char *data;
+    size_t len;
+    size_t cap;
+} TextBuffer;
+
+static void text_append(TextBuffer *text, const char *fmt, ...)
+{
+    if (!text->data)
+        return; // an earlier allocation failed
+    for (;;)
+    {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(text->data + text->len, text->cap - text->len, fmt, args);
+        va_end(args);
+        if (n < 0)
+            return;
+        if ((size_t)n < text->cap - text->len)
+        {
+            text->len += (size_t)n;
+            return;
+        }
+        char *grown = (char *)realloc(text->data, text->cap * 2);
+        if (!grown)
+        {
+            free(text->data);
+            text->data = NULL;
+            return;
+        }
+        text->data = grown;
+        text->cap *= 2;
+    }
+}
+
+static void metrics_render(ChannelMetrics *metrics, TextBuffer *text)
+{
+    uint64_t now = now_ns();
+    uint64_t slots = (now - metrics->origin) / metrics->slot_time;
+    uint64_t success = atomic_load_explicit(&metrics->success_slots, memory_order_relaxed);
+    uint64_t collision = atomic_load_explicit(&metrics->collision_slots, memory_order_relaxed);
+    uint64_t transmissions = atomic_load_explicit(&metrics->transmissions, memory_order_relaxed);
+    if (slots < success + collision)
+        slots = success + collision; // the slot being resolved may not have ended on our clock
+    double per_slot = slots > 0 ? 1.0 / (double)slots : 0.0;
+
+    text_append(text, "# HELP aloha_slots_total Slots since the channel started, by outcome.\n");
+    text_append(text, "# TYPE aloha_slots_total counter\n");
+    text_append(text, "aloha_slots_total{outcome=\"idle\"} %llu\n", (unsigned long long)(slots - success - collision));
+    text_append(text, "aloha_slots_total{outcome=\"success\"} %llu\n", (unsigned long long)success);
+    text_append(text, "aloha_slots_total{outcome=\"collision\"} %llu\n", (unsigned long long)collision);
+    text_append(text, "# HELP aloha_transmissions_total Frames received from stations, collided ones included.\n");
+    text_append(text, "# TYPE aloha_transmissions_total counter\n");
+    text_append(text, "aloha_transmissions_total %llu\n", (unsigned long long)transmissions);
+    text_append(text, "# HELP aloha_offered_load Transmissions per slot since the start (G).\n");
+    text_append(text, "# TYPE aloha_offered_load gauge\n");
+    text_append(text, "aloha_offered_load %.6f\n", (double)transmissions * per_slot);
+    text_append(text, "# HELP aloha_throughput Successful slots per slot since the start (S).\n");
+    text_append(text, "# TYPE aloha_throughput gauge\n");
+    text_append(text, "aloha_throughput %.6f\n", (double)success * per_slot);
+    text_append(text, "# HELP aloha_utilization Fraction of slots that carried at least one frame.\n");
+    text_append(text, "# TYPE aloha_utilization gauge\n");
+    text_append(text, "aloha_utilization %.6f\n", (double)(success + collision) * per_slot);
+
+    int stations = 0;
+    for (int i = 0; i < MAX_SERVERS; i++)
+    {
+        if (atomic_load_explicit(&metrics->stations[i].state, memory_order_acquire) == METRICS_LIVE)
+            stations++;
+    }
+    text_append(text, "# HELP aloha_stations Stations connected to the channel.\n");
+    text_append(text, "# TYPE aloha_stations gauge\n");
+    text_append(text, "aloha_stations %d\n", stations);
+
+    static const char *station_metrics[][3] = {
+        {"aloha_station_frames_total", "counter", "Frames received from the station."},
+        {"aloha_station_collisions_total", "counter", "Frames of the station lost to collisions."},
+        {"aloha_station_bandwidth_mbps", "gauge", "Average bandwidth received from the station since it connected."},
+    };
+    for (int k = 0; k < 3; k++)
+    {
+        text_append(text, "# HELP %s %s\n", station_metrics[k][0], station_metrics[k][2]);
+        text_append(text, "# TYPE %s %s\n", station_metrics[k][0], station_metrics[k][1]);
+        for (int i = 0; i < MAX_SERVERS; i++)
+        {
+            StationSnapshot m;
+            if (!station_snapshot(&metrics->stations[i], &m))
+                continue;
+            if (k == 2)
+            {
+                double elapsed = now > m.start_time ? (double)(now - m.start_time) / NS_PER_SEC : 0.0;
+                double bits = (double)m.frames * m.frame_size * 8;
+                text_append(text, "%s{address=\"%s\",port=\"%d\"} %.3f\n", station_metrics[k][0], m.address, m.port,
+                            elapsed > 0 ? bits / (elapsed * 1000000) : 0.0);
+            }
+            else
+            {
+                text_append(text, "%s{address=\"%s\",port=\"%d\"} %llu\n", station_metrics[k][0], m.address, m.port,
+                            (unsigned long long)(k == 0 ? m.frames : m.collisions));
+            }
+        }
+    }
+}
+
+// Answer one scrape. Whatever was asked for, the answer is the metrics page.
+static void metrics_serve(ChannelMetrics *metrics, SOCKET client)
+{
+    char request[MSG_SIZE];
+    recv(client, request, sizeof(request), 0); // only read so the peer doesn't see a reset
+
+    TextBuffer text = {(char *)malloc(16384), 0, 16384};
+    metrics_render(metrics, &text);
+    if (!text.data)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return;
+    }
+    char head[128];
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\n\r\n",
+                            (unsigned long)text.len);
+    if (send(client, head, head_len, 0) == head_len)
+        send(client, text.data, (int)text.len, 0);
+    free(text.data);
+}
+
+static thread_ret_t THREAD_CALL metrics_thread(void *arg)
+{
+    ChannelMetrics *metrics = (ChannelMetrics *)arg;
+    while (!atomic_load(&metrics->closing))
+    {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(metrics->listener, &read_fds);
+        struct timeval timeout = {0, METRICS_POLL_MS * 1000};
+        if (select((int)metrics->listener + 1, &read_fds, NULL, NULL, &timeout) <= 0)
+            continue;
+        SOCKET client = accept(metrics->listener, NULL, NULL);
+        if (client == INVALID_SOCKET)
+            continue;
+#ifdef _WIN32
+        int recv_timeout = 1000;
+#else
+        struct timeval recv_timeout = {1, 0};
+#endif
+        // A scraper that connects and says nothing must not stall the next one for long
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char *)&recv_timeout, sizeof(recv_timeout));
+        metrics_serve(metrics, client);
+        closesocket(client);
+    }
+    return 0;
+}
+
+// Serve metrics on 127.0.0.1:port until metrics_stop(). Returns 0 if the port can't be opened.
+int metrics_start(int port, int slot_time)
+{
+    ChannelMetrics *metrics = (ChannelMetrics *)calloc(1, sizeof(ChannelMetrics));
+    if (!metrics)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    metrics->origin = now_ns();
+    metrics->slot_time = (slot_time > 0 ? (uint64_t)slot_time : 1) * NS_PER_MS;
+
+    metrics->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (metrics->listener == INVALID_SOCKET)
+    {
+        fprintf(stderr, "Error creating metrics socket: %d\n", WSAGetLastError());
+        free(metrics);
+        return 0;
+    }
+    int on = 1;
+    setsockopt(metrics->listener, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1"); // counters are for the operator, not the network
+    addr.sin_port = htons(port);
+    if (bind(metrics->listener, (SOCKADDR *)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(metrics->listener, 8) == SOCKET_ERROR)
+    {
+        fprintf(stderr, "Metrics port %d unavailable: %d\n", port, WSAGetLastError());
+        closesocket(metrics->listener);
+        free(metrics);
+        return 0;
+    }
+
+    active = metrics;
+    if (!thread_start(&metrics->thread, metrics_thread, metrics))
+    {
+        fprintf(stderr, "Failed to start the metrics server\n");
+        active = NULL;
+        closesocket(metrics->listener);
+        free(metrics);
+        return 0;
+    }
+    printf("Metrics on http://127.0.0.1:%d/metrics\n", port);
+    return 1;
+}
+
+// Stop serving. Stations must no longer be touching their cells.
+void metrics_stop(void)
+{
+    if (!active)
+        return;
+    atomic_store(&active->closing, 1);
+    thread_join(active->thread);
+    closesocket(active->listener);
+    free(active);
+    active = NULL;
+}
@@ -2,11 +2,19 @@
 
 volatile int stop_flag = 0; // Shared flag to signal stop
 
+#ifndef _WIN32
+static void handle_stop_signal(int sig)
+{
+    (void)sig;
+    stop_flag = 1;
+}
+#endif
+
 int main(int argc, char *argv[])
 {
-    if (argc != 8)
+    if (argc < 8 || argc > 12)
     {
-        fprintf(stderr, "Usage: %s <chan_ip> <chan_port> <file_name> <frame_size> <slot_time> <seed> <timeout>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <chan_ip> <chan_port> <file_name> <frame_size> <slot_time> <seed> <timeout> [window] [hist_file|-] [mac] [backoff]\n", argv[0]);
         return 1;
     }
     Input *s1 = (Input *)malloc(sizeof(Input));
@@ -30,9 +38,36 @@ int main(int argc, char *argv[])
     s1->slot_time = atoi(argv[5]);
     s1->seed = atoi(argv[6]);
     s1->timeout = atoi(argv[7]);
-
-    srand(s1->seed);
-
+    s1->window = argc >= 9 ? atoi(argv[8]) : 1;
+    if (s1->window < 1)
+        s1->window = 1;
+    s1->hist_file = argc >= 10 && strcmp(argv[9], "-") != 0 ? argv[9] : NULL;
+    if (!mac_parse(argc >= 11 ? argv[10] : "slotted", &s1->mac))
+    {
+        fprintf(stderr, "Unknown MAC protocol: %s\n", argv[10]);
+        free(s1);
+        free(out);
+        return 1;
+    }
+    if (!backoff_parse(argc == 12 ? argv[11] : "beb", &s1->backoff))
+    {
+        fprintf(stderr, "Unknown backoff policy: %s\n", argv[11]);
+        free(s1);
+        free(out);
+        return 1;
+    }
+    histogram_init(&out->echo_latency, "Echo latency");
+    histogram_init(&out->frame_latency, "Frame latency");
+    histogram_init(&out->backoff_wait, "Backoff wait");
+
+    // Pipelined mode's backoff stream; a given seed replays the same backoffs on any platform
+    Rng rng;
+    rng_seed(&rng, (uint64_t)s1->seed, 0);
+    // This station's view of the backlog: its own collisions and the deliveries it hears
+    BackoffEstimator est;
+    backoff_estimator_init(&est);
+
+#ifdef _WIN32
     // Initialize Winsock
     WSADATA wsaData;
     int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
@@ -43,12 +78,23 @@ int main(int argc, char *argv[])
         free(out);
         return 1;
     }
+#else
+    // Ctrl+C stops after the current frame, as the console handler does on Windows
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+#endif
 
     SOCKET sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd == INVALID_SOCKET)
     {
         fprintf(stderr, "Socket creation failed: %d\n", WSAGetLastError());
+#ifdef _WIN32
         WSACleanup();
+#endif
         free(s1);
         free(out);
         return 1;
@@ -65,37 +111,40 @@ int main(int argc, char *argv[])
     {
         fprintf(stderr, "Connection failed: %d\n", WSAGetLastError());
         closesocket(sockfd);
+#ifdef _WIN32
         WSACleanup();
+#endif
         free(s1);
         free(out);
         return 1;
     }
 
+    set_nodelay(sockfd);
+
     // Open file
-    FILE *f = fopen(s1->file_name, "rb");
-    if (!f)
+    InputSource in;
+    if (!input_open(&in, s1->file_name))
     {
         fprintf(stderr, "Failed to open file: %s\n", s1->file_name);
         closesocket(sockfd);
+#ifdef _WIN32
         WSACleanup();
+#endif
         free(s1);
         free(out);
         return 1;
     }
 
-    // Allocate buffers
-    char *frame = (char *)malloc(s1->frame_size + 1);
-    char *received = (char *)malloc(s1->frame_size + 1);
-    if (!frame || !received)
+    // Zero padding for a short last frame
+    char *padding = (char *)calloc(s1->frame_size + 1, 1);
+    if (!padding)
     {
         fprintf(stderr, "Memory allocation failed\n");
-        fclose(f);
+        input_close(&in);
         closesocket(sockfd);
+#ifdef _WIN32
         WSACleanup();
-        if (frame)
-            free(frame);
-        if (received)
-            free(received);
+#endif
         free(s1);
         free(out);
         return 1;
@@ -104,10 +153,14 @@ int main(int argc, char *argv[])
     int total_transmissions = 0;
     int num_frames = 0;
     out->success = 1;
-    DWORD start_time = GetTickCount();
+    uint64_t start_time = now_ns();
 
     // Set receive timeout (in milliseconds)
+#ifdef _WIN32
     int timeout_ms = s1->timeout * 1000; // 5 seconds
+#else
+    struct timeval timeout_ms = {s1->timeout, 0};
+#endif
     if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout_ms, sizeof(timeout_ms)) == SOCKET_ERROR)
     {
         fprintf(stderr, "setsockopt SO_RCVTIMEO failed: %d\n", WSAGetLastError());
@@ -119,193 +172,306 @@ int main(int argc, char *argv[])
         fprintf(stderr, "setsockopt SO_SNDTIMEO failed: %d\n", WSAGetLastError());
     }
 
-    while (!feof(f) && !stop_flag)
+#ifdef _WIN32
+    SetConsoleCtrlHandler(ctrl_handler, TRUE);
+#endif
+    if (s1->window > 1)
     {
-        SetConsoleCtrlHandler(ctrl_handler, TRUE);
-
-        memset(frame, 0, s1->frame_size + 1);
-        memset(received, 0, s1->frame_size + 1);
+        // Pipelined mode: keep several sequenced frames in flight instead of waiting on each echo
+        send_file_windowed(sockfd, &in, s1, out, &rng, &est, &total_transmissions, &num_frames);
+    }
+    else
+    {
+        // Stop-and-wait: a single station on the event loop, stream 0 as in pipelined mode
+        Station station;
+        if (!station_init(&station, sockfd, &in, s1, out, padding, 0))
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            out->success = 0;
+        }
+        else if (!station_loop_run(&station, 1))
+        {
+            out->success = 0;
+        }
+        total_transmissions = station.total_transmissions;
+        num_frames = station.num_frames;
+        station_free(&station);
+    }
 
-        // Read a frame from the file
-        size_t read_bytes = fread(frame, 1, s1->frame_size, f);
-        if (read_bytes <= 0)
-            break; // EOF or error
+    printf("finished sending file\n");
 
-        char *packet = malloc(HEADER_SIZE + s1->frame_size + 1);
-        memset(packet, 0, HEADER_SIZE + s1->frame_size + 1); // Initialize packet buffer
+    print_summary(out, s1->file_name, s1->frame_size, num_frames, total_transmissions, now_ns() - start_time);
+    histogram_print(&out->echo_latency);
+    histogram_print(&out->frame_latency);
+    histogram_print(&out->backoff_wait);
+    fprintf(stderr, "\n");
 
-        if (!packet)
+    if (s1->hist_file)
+    {
+        FILE *hist = fopen(s1->hist_file, "w");
+        if (hist)
         {
-            fprintf(stderr, "Memory allocation failed\n");
-            continue; // Try the next frame
+            histogram_dump(&out->echo_latency, hist);
+            histogram_dump(&out->frame_latency, hist);
+            histogram_dump(&out->backoff_wait, hist);
+            fclose(hist);
         }
+        else
+        {
+            fprintf(stderr, "Failed to open histogram file: %s\n", s1->hist_file);
+        }
+    }
 
-        // Build Ethernet header
-        // Destination MAC (6 bytes)
-        memcpy(packet, "\xAA\xBB\xCC\xDD\xEE\xFF", 6);
+    // Clean up
+    input_close(&in);
+    closesocket(sockfd);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    free(padding);
+    free(s1);
+    // free(out);
 
-        // Append src MAC (6 bytes)
-        memcpy(packet + 6, "\x11\x22\x33\x44\x55\x66", 6);
+    return out->success ? 0 : 1;
+}
 
-        // Append ethertype (2 bytes, let's say 0x0800)
-        packet[12] = 0x08;
-        packet[13] = 0x01;
+// Sliding-window transmitter: up to s1->window sequenced frames are in flight at once. ACK and
+// NOISE control frames name the station and sequence number they answer, so each reply is
+// matched to its frame from the header alone. A collided frame waits out its backoff while the
+// rest of the window keeps moving; no thread ever sleeps in Sleep().
+void send_file_windowed(SOCKET sockfd, InputSource *in, Input *s1, OutputServer *out, Rng *rng, BackoffEstimator *est, int *total_transmissions, int *num_frames)
+{
+    int window = s1->window;
+    uint64_t timeout_ns = (uint64_t)s1->timeout * NS_PER_SEC;
+    WindowSlot *slots = (WindowSlot *)calloc(window, sizeof(WindowSlot));
+    int reply_cap = s1->frame_size + 1;
+    char *reply = (char *)malloc(reply_cap);
+    char *padding = (char *)calloc(s1->frame_size + 1, 1);
+    char reply_hdr[HEADER_V2_SIZE];
+    if (!slots || !reply || !padding)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(slots);
+        free(reply);
+        free(padding);
+        out->success = 0;
+        return;
+    }
+    for (int i = 0; i < window && !in->map; i++)
+    {
+        slots[i].scratch = (char *)malloc(s1->frame_size);
+        if (!slots[i].scratch)
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            out->success = 0;
+            window = i;
+            break;
+        }
+    }
 
-        // Append frame size (4 bytes, big-endian)
-        packet[14] = (s1->frame_size >> 24) & 0xFF;
-        packet[15] = (s1->frame_size >> 16) & 0xFF;
-        packet[16] = (s1->frame_size >> 8) & 0xFF;
-        packet[17] = s1->frame_size & 0xFF;
+    // The local port tells our frames apart from the ones other stations get forwarded to us
+    struct sockaddr_in local_addr;
+    socklen_t local_len = sizeof(local_addr);
+    uint16_t station_id = 0;
+    if (getsockname(sockfd, (struct sockaddr *)&local_addr, &local_len) == 0)
+        station_id = ntohs(local_addr.sin_port);
 
-        // Append actual payload
-        memcpy(packet + HEADER_SIZE, frame, s1->frame_size);
-        frame[s1->frame_size] = '\0';
-        packet[HEADER_SIZE + read_bytes] = '\0'; // Null-terminate the packet
+    uint32_t next_seq = 0;
+    int outstanding = 0;
+    int eof = 0;
 
-        int transmissions = 0;
-        int collisions = 0;
-        int not_sent = 1;
+    while (out->success && !stop_flag)
+    {
+        uint64_t now = now_ns();
 
-        // Wait for initial slot
-        exponential_backoff(0, s1->slot_time);
-        // Attempt to send the frame
-        while (not_sent && !stop_flag)
+        // Refill free window slots from the file
+        for (int i = 0; i < window && !eof; i++)
         {
-            DWORD start_frame_time = GetTickCount();
-            // Send the packet (header + payload)
-            int send_result = send(sockfd, packet, HEADER_SIZE + s1->frame_size, 0);
-            if (send_result == SOCKET_ERROR)
+            if (slots[i].in_use)
+                continue;
+            slots[i].payload = input_next_frame(in, slots[i].scratch, s1->frame_size, &slots[i].payload_len);
+            if (!slots[i].payload)
             {
-                fprintf(stderr, "Send failed: %d\n", WSAGetLastError());
-                not_sent = 0; // Break out of retry loop
-                out->success = 0;
+                eof = 1;
                 break;
             }
-            transmissions++;
-            // Receive response
-            int recv_result = recv(sockfd, received, s1->frame_size, 0);
-            DWORD curr_time = GetTickCount();
+            slots[i].seq = next_seq++;
+            build_header_v2(slots[i].header, FRAME_DATA, station_id, slots[i].seq, (uint32_t)slots[i].payload_len, (uint32_t)s1->frame_size);
+            header_v2_seal(slots[i].header, frame_crc(slots[i].header, slots[i].payload, slots[i].payload_len, padding,
+                                                      s1->frame_size - slots[i].payload_len));
+            slots[i].in_use = 1;
+            slots[i].in_flight = 0;
+            slots[i].transmissions = 0;
+            backoff_done(&slots[i].backoff);
+            slots[i].retry_at = now + (uint64_t)backoff_first(&s1->backoff, est, rng) * s1->slot_time * NS_PER_MS;
+            slots[i].backoff_from = now;
+            slots[i].backoff_ns = 0;
+            outstanding++;
+        }
+        if (outstanding == 0)
+            break; // whole file acknowledged
 
-            // Check for timeout
-            if (recv_result == SOCKET_ERROR)
+        // Transmit every frame that is due, and find how long we may wait for a reply
+        uint64_t wait_ns = timeout_ns;
+        for (int i = 0; i < window; i++)
+        {
+            WindowSlot *slot = &slots[i];
+            if (!slot->in_use)
+                continue;
+            if (!slot->in_flight && now >= slot->retry_at)
             {
-                int error = WSAGetLastError();
-                if (error == WSAETIMEDOUT)
+                if (send_frame(sockfd, slot->header, HEADER_V2_SIZE, slot->payload, slot->payload_len, s1->frame_size, padding) == SOCKET_ERROR)
                 {
-                    printf("Timeout occurred\n"); // DEBUG
-                    collisions++;
-                    printf("Collision count: %d, transmissions: %d\n", collisions, transmissions); // DEBUG
-                    exponential_backoff(collisions, s1->slot_time);
-                    continue;
-                }
-                else
-                {
-                    int error = WSAGetLastError();
-                    fprintf(stderr, "Receive failed with error code: %d\n", error);
-                    not_sent = 0;
+                    fprintf(stderr, "Send failed: %d\n", WSAGetLastError());
                     out->success = 0;
                     break;
                 }
+                if (slot->transmissions == 0)
+                    slot->first_sent_at = now;
+                else
+                    slot->backoff_ns += now - slot->backoff_from;
+                slot->transmissions++;
+                slot->in_flight = 1;
+                slot->sent_at = now;
             }
-            if (recv_result <= 0)
+            uint64_t deadline = slot->in_flight ? slot->sent_at + timeout_ns : slot->retry_at;
+            uint64_t left = deadline > now ? deadline - now : 0;
+            if (left < wait_ns)
+                wait_ns = left;
+        }
+        if (!out->success)
+            break;
+
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(sockfd, &read_fds);
+        struct timeval tv;
+        tv.tv_sec = (long)(wait_ns / NS_PER_SEC);
+        tv.tv_usec = (long)((wait_ns % NS_PER_SEC + 999) / 1000);
+        int ready = select((int)sockfd + 1, &read_fds, NULL, NULL, &tv);
+        if (ready == SOCKET_ERROR)
+        {
+#ifndef _WIN32
+            if (errno == EINTR)
                 continue;
-            if (strncmp(received, "!!!!!!!!!!!!!!!!!NOISE!!!!!!!!!!!!!!!!!", 39) == 0)
+#endif
+            fprintf(stderr, "Select failed: %d\n", WSAGetLastError());
+            out->success = 0;
+            break;
+        }
+
+        WindowSlot *collided = NULL;
+        if (ready > 0)
+        {
+            if (recv_all(sockfd, reply_hdr, HEADER_V2_SIZE) != HEADER_V2_SIZE)
+            {
+                fprintf(stderr, "Receive failed with error code: %d\n", WSAGetLastError());
+                out->success = 0;
+                break;
+            }
+            FrameHeader fh;
+            if (!header_v2_parse(reply_hdr, &fh) || fh.body_len > MAX_FRAME_SIZE)
+            {
+                fprintf(stderr, "Malformed reply from the channel\n");
+                out->success = 0;
+                break;
+            }
+            int reply_len = (int)fh.body_len;
+            if (reply_len + 1 > reply_cap)
             {
-                if (collisions >= 10)
+                char *grown = (char *)realloc(reply, reply_len + 1);
+                if (!grown)
                 {
-                    printf("Maximum collisions reached for this frame\n");
+                    fprintf(stderr, "Memory allocation failed\n");
                     out->success = 0;
                     break;
                 }
-                printf("NOISE detected - collision occurred\n"); // DEBUG
-                collisions++;
-                printf("Collision count: %d, transmissions: %d\n", collisions, transmissions);
-
-                // Back off exponentially
-                exponential_backoff(collisions, s1->slot_time);
-                continue;
+                reply = grown;
+                reply_cap = reply_len + 1;
             }
-            // Check for user interrupt
-            if (stop_flag)
-                break;
-
-            // Check for too many collisions
-            if (collisions >= 10)
+            if (reply_len > 0 && recv_all(sockfd, reply, reply_len) != reply_len)
             {
-                printf("Maximum collisions reached for this frame\n");
+                fprintf(stderr, "Receive failed with error code: %d\n", WSAGetLastError());
                 out->success = 0;
                 break;
             }
-            // Successful transmission if we received our frame back
-            if (memcmp(received, frame, recv_result) == 0)
+
+            uint32_t reply_seq = fh.seq;
+            if ((fh.flags & FRAME_DATA) || fh.station_id != station_id)
             {
-                printf("Frame successfully transmitted\n");
-                not_sent = 0;
+                backoff_observe(est, SLOT_SUCCESS, 1);
+                continue; // another station's frame
             }
-            else
+
+            WindowSlot *slot = NULL;
+            for (int i = 0; i < window; i++)
             {
-                printf("Received unexpected data: %s, retrying...\n", received);
-                collisions++;
-                exponential_backoff(collisions, s1->slot_time);
+                if (slots[i].in_flight && slots[i].seq == reply_seq)
+                {
+                    slot = &slots[i];
+                    break;
+                }
             }
-        }
-        // Free packet memory
-        free(packet);
+            if (!slot)
+                continue; // late reply for a frame we already timed out and resent
 
-        // Break if transmission failed or user interrupted
-        if (!out->success || stop_flag)
-            break;
-
-        if (transmissions > out->max_transmissions)
-            out->max_transmissions = transmissions;
-        total_transmissions += transmissions;
-        num_frames++;
-    }
-
-    printf("finished sending file\n");
-
-    // Fill OutputServer structure
-    out->num_of_packets = num_frames;
-    out->file_name = s1->file_name;
-    out->file_size = num_frames * s1->frame_size;
-    out->total_time = GetTickCount() - start_time;
+            if (fh.flags & FRAME_NOISE)
+            {
+                printf("NOISE detected - collision occurred (seq %u)\n", reply_seq); // DEBUG
+                collided = slot;
+            }
+            else // ACK
+            {
+                printf("Frame successfully transmitted (seq %u)\n", reply_seq);
+                backoff_observe(est, SLOT_SUCCESS, 1);
+                uint64_t echoed_at = now_ns();
+                histogram_record(&out->echo_latency, echoed_at - slot->sent_at);
+                histogram_record(&out->frame_latency, echoed_at - slot->first_sent_at);
+                histogram_record(&out->backoff_wait, slot->backoff_ns);
+                if (slot->transmissions > out->max_transmissions)
+                    out->max_transmissions = slot->transmissions;
+                *total_transmissions += slot->transmissions;
+                (*num_frames)++;
+                slot->in_use = 0;
+                slot->in_flight = 0;
+                outstanding--;
+            }
+        }
+        else
+        {
+            // Nothing arrived in time: the oldest overdue frame is treated like a collision. Slots
+            // are reused in ring order, so the oldest is the one sent first, not the lowest index.
+            now = now_ns();
+            for (int i = 0; i < window; i++)
+            {
+                if (slots[i].in_flight && now - slots[i].sent_at >= timeout_ns &&
+                    (!collided || slots[i].sent_at < collided->sent_at))
+                    collided = &slots[i];
+            }
+            if (collided)
+                printf("Timeout occurred (seq %u)\n", collided->seq); // DEBUG
+        }
 
-    if (num_frames > 0)
-    {
-        out->avg_transmissions = (double)total_transmissions / num_frames;
-        out->avg_bw = (double)(num_frames * s1->frame_size * 8) / (out->total_time * 1000);
+        if (collided)
+        {
+            backoff_observe(est, SLOT_COLLISION, 1);
+            int wait = backoff_next(&s1->backoff, &collided->backoff, est, rng);
+            if (wait < 0)
+            {
+                printf("Maximum collisions reached for this frame\n");
+                out->success = 0;
+                break;
+            }
+            printf("Collision count: %d, transmissions: %d\n", collided->backoff.collisions, collided->transmissions);
+            collided->in_flight = 0;
+            collided->backoff_from = now_ns();
+            collided->retry_at = collided->backoff_from + (uint64_t)wait * s1->slot_time * NS_PER_MS;
+        }
     }
-    fprintf(stderr, "\nSent file %s\n", out->file_name);
-    fprintf(stderr, "Result: %s \n", out->success ? "Success :)" : "Failure :(");
-    fprintf(stderr, "File size: %d Bytes (%d frames)\n", out->file_size, out->num_of_packets);
-    fprintf(stderr, "Total transfer time: %d milliseconds\n", out->total_time);
-    fprintf(stderr, "Transmissions/frame: average %.3f, maximum %d\n", out->avg_transmissions, out->max_transmissions);
-    fprintf(stderr, "Average bandwidth: %.3f Mbps\n\n", out->avg_bw);
-
-    // Clean up
-    fclose(f);
-    closesocket(sockfd);
-    WSACleanup();
-    free(frame);
-    free(received);
-    free(s1);
-    // free(out);
 
-    return out->success ? 0 : 1;
+    for (int i = 0; i < window; i++)
+        free(slots[i].scratch);
+    free(slots);
+    free(reply);
+    free(padding);
 }
-
-void exponential_backoff(int k, int slot_time)
-{
-    int r = rand() % (1 << k);
-    Sleep((r * slot_time) % 10000);
-}
-
-BOOL WINAPI ctrl_handler(DWORD ctrl_type)
-{
-    if (ctrl_type == CTRL_C_EVENT)
-    {
-        stop_flag = 1;
-        return TRUE;
-    }
-    return FALSE;
-}
\ No newline at end of file
@@ -0,0 +1,461 @@
+#include "header.h"
+
+// Sharded channel: the main thread accepts connections and deals them out round-robin to worker
+// shards. Each shard runs the same edge-triggered epoll loop as the single-threaded channel, but
+// over its own stations only, so receiving and fanning out scale with the number of shards.
+//
+// Slots are closed together. A shard whose slot has ended publishes its sender count (and, with
+// exactly one sender, that frame) and waits at a barrier built from two atomics; nothing is
+// locked on the per-slot path. Once every shard is in, each reads the summed count, so all of
+// them reach the same decision, and sends noise to its own senders or the winning frame to its
+// own stations.
+
+#ifdef __linux__
+
+#define BARRIER_SPINS 64 // busy polls before a waiting shard starts yielding its core
+
+static void shard_wake(ChannelShard *shard)
+{
+    uint64_t one = 1;
+    if (write(shard->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        fprintf(stderr, "Failed to wake shard %d: %d\n", shard->index, errno);
+}
+
+static void wake_all(ShardedChannel *ch)
+{
+    for (int i = 0; i < ch->num_shards; i++)
+        shard_wake(&ch->shards[i]);
+}
+
+// Wait for every shard to reach the end of the slot of parity p. The last one to arrive sets up
+// the next slot before releasing the others. Returns 0 if the channel is stopping.
+static int slot_barrier_wait(ShardedChannel *ch, int p)
+{
+    SlotBarrier *barrier = &ch->barrier;
+    unsigned generation = atomic_load(&barrier->generation);
+    if (atomic_fetch_add(&barrier->waiting, 1) == barrier->parties - 1)
+    {
+        // Everyone has read the previous slot's count by now, so its half can be reused
+        atomic_store(&ch->senders[p ^ 1], 0);
+        slot_clock_advance(&ch->clock);
+        atomic_store(&ch->slot_end, ch->clock.slot_end);
+        atomic_store(&barrier->waiting, 0);
+        atomic_store(&barrier->generation, generation + 1);
+        return 1;
+    }
+    for (int spins = 0; atomic_load(&barrier->generation) == generation; spins++)
+    {
+        if (atomic_load(&ch->stopping))
+            return 0;
+        if (spins >= BARRIER_SPINS)
+            sched_yield(); // the shard we wait for may need this core
+    }
+    return 1;
+}
+
+// Push a change in this shard's sender count into the shared count and apply the MAC's slot
+// rules to the shared slot end, as update_slot_end() does for a single loop
+static void shard_update_slot_end(ChannelShard *shard, int p)
+{
+    ShardedChannel *ch = shard->channel;
+    int senders = count_active(shard->head);
+    if (senders == shard->published)
+        return;
+    int delta = senders - shard->published;
+    int total = atomic_fetch_add(&ch->senders[p], delta) + delta;
+    shard->published = senders;
+
+    uint64_t now = now_ns();
+    if (ch->mac->collision_detect && total >= 2)
+    {
+        // Close the slot everywhere now: the other shards are asleep until the old end
+        atomic_store(&ch->slot_end, now);
+        for (int i = 0; i < ch->num_shards; i++)
+        {
+            if (i != shard->index)
+                shard_wake(&ch->shards[i]);
+        }
+    }
+    else if (!ch->mac->slotted)
+    {
+        // Only ever pushed back; a shard asleep until the old end looks again when it wakes
+        uint64_t end = atomic_load(&ch->slot_end);
+        while (end < now + ch->clock.slot_time && !atomic_compare_exchange_weak(&ch->slot_end, &end, now + ch->clock.slot_time))
+        {
+        }
+    }
+}
+
+// End of the slot of parity p for this shard. Returns 0 if the channel is stopping.
+static int shard_close_slot(ChannelShard *shard, int p)
+{
+    ShardedChannel *ch = shard->channel;
+    shard_update_slot_end(shard, p); // a disconnect may have changed the count since the last read
+    shard->senders[p] = shard->published;
+
+    SlotCandidate *candidate = &shard->candidate[p];
+    candidate->frame = NULL;
+    candidate->corrupt = shard->published == 1 && shard->head->next_sender->rx_corrupt;
+    if (shard->published == 1 && !candidate->corrupt)
+    {
+        // The buffer stays with the station unless this turns out to be the only frame. A damaged
+        // frame is never put up: with no winner, deliver_slot() answers it with noise. Besides each
+        // shard's reference there is one for the station, so the last release is on this shard.
+        OutputChannel *sender = shard->head->next_sender;
+        candidate->frame = shared_frame_wrap(sender->data_buffer);
+        if (candidate->frame)
+        {
+            candidate->frame->refs = ch->num_shards + 1;
+            candidate->len = sender->data_size;
+            candidate->hdr_len = reply_header_len(sender);
+            memcpy(candidate->hdr, sender->rx_header, candidate->hdr_len);
+        }
+    }
+
+    if (!slot_barrier_wait(ch, p))
+        return 0;
+
+    // A lone sender's shard said whether its frame was damaged, so every shard settles the same way
+    int senders = atomic_load(&ch->senders[p]);
+    int lone_corrupt = 0;
+    for (int i = 0; i < ch->num_shards && senders == 1; i++)
+    {
+        if (ch->shards[i].senders[p] == 1)
+            lone_corrupt = ch->shards[i].candidate[p].corrupt;
+    }
+    SlotOutcome outcome = settle_slot(senders, lone_corrupt);
+    if (shard->index == 0)
+        metrics_slot(outcome, senders); // every shard knows the outcome, one counts it
+    SlotCandidate *winner = NULL;
+    for (int i = 0; i < ch->num_shards && outcome == SLOT_SUCCESS; i++)
+    {
+        if (ch->shards[i].senders[p] == 1 && ch->shards[i].candidate[p].frame)
+        {
+            winner = &ch->shards[i].candidate[p];
+            break;
+        }
+    }
+
+    if (winner)
+    {
+        if (winner == candidate)
+        {
+            // Our station's frame goes out from every shard and the station reads on into its spare.
+            // The buffer comes back once every shard is done with it, as in station_send(). If an
+            // earlier one is still out, this one is freed by the last shard instead.
+            OutputChannel *sender = shard->head->next_sender;
+            station_reclaim(sender);
+            if (!sender->lent)
+            {
+                winner->frame->owner = sender;
+                winner->frame->capacity = sender->data_capacity;
+                sender->lent = winner->frame;
+                sender->lent_held = 1;
+            }
+            else
+            {
+                shared_frame_release(winner->frame);
+            }
+            sender->data_buffer = sender->spare_buffer;
+            sender->data_capacity = sender->spare_capacity;
+            sender->spare_buffer = NULL;
+            sender->spare_capacity = 0;
+        }
+        Fanout fan = {winner->hdr_len > 0 ? winner->hdr : NULL, winner->hdr_len, winner->frame->buf, winner->len, winner->frame, NULL};
+        deliver_slot(shard->head, &shard->noise, outcome, &fan);
+        shared_frame_release(winner->frame);
+    }
+    else
+    {
+        if (candidate->frame)
+        {
+            free(candidate->frame); // not the only sender: the wrapper goes, the buffer stays
+            candidate->frame = NULL;
+        }
+        deliver_slot(shard->head, &shard->noise, outcome, NULL);
+    }
+    shard->published = 0;
+    return 1;
+}
+
+// Take over the connections the acceptor has handed to this shard
+static void shard_adopt(ChannelShard *shard)
+{
+    mutex_lock(&shard->inbox_lock);
+    for (int i = 0; i < shard->inbox_count; i++)
+    {
+        OutputChannel *station = add_station(shard->inbox[i].socket, &shard->inbox[i].addr, &shard->current);
+        if (!station || !index_station(&shard->table, &shard->current, station))
+            continue;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = station;
+        epoll_ctl(shard->epfd, EPOLL_CTL_ADD, station->socket, &ev);
+    }
+    shard->inbox_count = 0;
+    mutex_unlock(&shard->inbox_lock);
+}
+
+static thread_ret_t THREAD_CALL shard_main(void *arg)
+{
+    ChannelShard *shard = (ChannelShard *)arg;
+    ShardedChannel *ch = shard->channel;
+    struct epoll_event events[MAX_EVENTS];
+
+    // Stations whose socket may still hold unread bytes, as in the single-threaded loop
+    OutputChannel **ready_list = NULL;
+    int num_ready = 0;
+    int ready_cap = 0;
+    int parity = 0; // of the slot being collected
+
+    while (!atomic_load(&ch->stopping))
+    {
+        uint64_t now = now_ns();
+        uint64_t slot_end = atomic_load(&ch->slot_end);
+        if (now >= slot_end)
+        {
+            if (!shard_close_slot(shard, parity))
+                break;
+            parity ^= 1;
+            continue;
+        }
+
+        // Sleep until the slot boundary, unless a station that hasn't sent yet has input buffered
+        int wait_ms = (int)((slot_end - now + NS_PER_MS - 1) / NS_PER_MS);
+        for (int i = 0; i < num_ready && wait_ms > 0; i++)
+        {
+            if (!ready_list[i]->send_in_slot)
+                wait_ms = 0;
+        }
+        int ready = epoll_wait(shard->epfd, events, MAX_EVENTS, wait_ms);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "epoll_wait failed in shard %d: %d\n", shard->index, errno);
+            atomic_store(&ch->stopping, 1); // the others would wait for us at the barrier forever
+            wake_all(ch);
+            break;
+        }
+
+        for (int i = 0; i < ready; i++)
+        {
+            OutputChannel *ptr = (OutputChannel *)events[i].data.ptr;
+            if (!ptr) // Wakeup: new stations, an early slot end or stop
+            {
+                uint64_t count;
+                while (read(shard->wake_fd, &count, sizeof(count)) > 0)
+                {
+                }
+                shard_adopt(shard);
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && ptr->tx_head && !flush_tx(ptr))
+            {
+                fprintf(stderr, "Error sending data: %d\n", errno);
+                clear_tx(ptr); // the read side will see the disconnect
+            }
+            if (ptr->readable || !(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)))
+                continue;
+
+            if (num_ready == ready_cap)
+            {
+                int new_cap = ready_cap ? ready_cap * 2 : MAX_EVENTS;
+                OutputChannel **grown = (OutputChannel **)realloc(ready_list, new_cap * sizeof(OutputChannel *));
+                if (!grown)
+                {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    continue;
+                }
+                ready_list = grown;
+                ready_cap = new_cap;
+            }
+            ptr->readable = 1;
+            ready_list[num_ready++] = ptr;
+        }
+
+        // Read one frame per slot from every ready station, keeping the ones with more input pending
+        int still_ready = 0;
+        for (int i = 0; i < num_ready; i++)
+        {
+            OutputChannel *ptr = ready_list[i];
+            if (ptr->send_in_slot)
+            {
+                ready_list[still_ready++] = ptr;
+                continue;
+            }
+            RxStatus status = receive_frame(shard->head, ptr);
+            if (status == RX_CLOSED)
+            {
+                disconnect_server(shard->head, &shard->current, &shard->table, ptr, ch->log);
+                continue;
+            }
+            if (status == RX_PENDING)
+            {
+                ptr->readable = 0;
+                continue;
+            }
+            ready_list[still_ready++] = ptr;
+        }
+        num_ready = still_ready;
+        shard_update_slot_end(shard, parity);
+    }
+
+    for (OutputChannel *ptr = shard->head->next; ptr; ptr = ptr->next)
+        log_server_stats(ptr, ch->log);
+    free(ready_list);
+    return 0;
+}
+
+static int shard_init(ShardedChannel *ch, ChannelShard *shard, int index)
+{
+    memset(shard, 0, sizeof(ChannelShard));
+    shard->channel = ch;
+    shard->index = index;
+    shard->epfd = -1;
+    shard->wake_fd = -1;
+    shard->head = (OutputChannel *)calloc(1, sizeof(OutputChannel));
+    if (!shard->head || !station_table_init(&shard->table, 64))
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(shard->head);
+        shard->head = NULL;
+        return 0;
+    }
+    shard->current = shard->head;
+    mutex_init(&shard->inbox_lock);
+
+    shard->epfd = epoll_create1(0);
+    shard->wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (shard->epfd < 0 || shard->wake_fd < 0)
+    {
+        fprintf(stderr, "Failed to set up shard %d: %d\n", index, errno);
+        return 0;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // NULL marks the wakeup descriptor, stations carry their OutputChannel
+    epoll_ctl(shard->epfd, EPOLL_CTL_ADD, shard->wake_fd, &ev);
+    return 1;
+}
+
+static void shard_free(ChannelShard *shard)
+{
+    if (!shard->head)
+        return;
+    if (shard->epfd >= 0)
+        close(shard->epfd);
+    if (shard->wake_fd >= 0)
+        close(shard->wake_fd);
+    for (int i = 0; i < shard->inbox_count; i++)
+        closesocket(shard->inbox[i].socket);
+    free(shard->inbox);
+    mutex_destroy(&shard->inbox_lock);
+    if (shard->noise.frame)
+        shared_frame_release(shard->noise.frame);
+    station_table_free(&shard->table);
+    free_list_1(shard->head);
+}
+
+// Queue an accepted connection for a shard to pick up at its next wakeup
+static int shard_hand_over(ChannelShard *shard, SOCKET socket, const struct sockaddr_in *addr)
+{
+    mutex_lock(&shard->inbox_lock);
+    if (shard->inbox_count == shard->inbox_cap)
+    {
+        int new_cap = shard->inbox_cap ? shard->inbox_cap * 2 : 16;
+        PendingStation *grown = (PendingStation *)realloc(shard->inbox, new_cap * sizeof(PendingStation));
+        if (!grown)
+        {
+            mutex_unlock(&shard->inbox_lock);
+            fprintf(stderr, "Memory allocation failed\n");
+            return 0;
+        }
+        shard->inbox = grown;
+        shard->inbox_cap = new_cap;
+    }
+    shard->inbox[shard->inbox_count].socket = socket;
+    shard->inbox[shard->inbox_count].addr = *addr;
+    shard->inbox_count++;
+    mutex_unlock(&shard->inbox_lock);
+    shard_wake(shard);
+    return 1;
+}
+
+// Run the channel on num_shards worker threads until Ctrl+Z, accepting on this one. Returns 0
+// if the shards could not be set up.
+int run_sharded(SOCKET tcp_s, const Input *c1, int num_shards, LogQueue *log)
+{
+    ShardedChannel ch;
+    memset(&ch, 0, sizeof(ch));
+    ch.mac = &c1->mac;
+    ch.num_shards = num_shards;
+    ch.barrier.parties = num_shards;
+    ch.log = log;
+    ch.shards = (ChannelShard *)calloc(num_shards, sizeof(ChannelShard));
+    if (!ch.shards)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+
+    int ok = 1;
+    for (int i = 0; i < num_shards && ok; i++)
+        ok = shard_init(&ch, &ch.shards[i], i);
+
+    slot_clock_init(&ch.clock, c1->slot_time);
+    atomic_store(&ch.slot_end, ch.clock.slot_end);
+    int started = 0;
+    for (; started < num_shards && ok; started++)
+    {
+        if (!thread_start(&ch.shards[started].thread, shard_main, &ch.shards[started]))
+        {
+            fprintf(stderr, "Failed to start shard %d\n", started);
+            ok = 0;
+            break;
+        }
+    }
+
+    if (ok)
+    {
+        printf("Channel running on %d shards\n", num_shards);
+        set_nonblocking(tcp_s);
+        struct pollfd pfd;
+        pfd.fd = tcp_s;
+        pfd.events = POLLIN;
+        int next = 0;
+        while (!stop_flag && !atomic_load(&ch.stopping))
+        {
+            // Wake up now and then to notice Ctrl+Z, which may be delivered to a shard's thread
+            if (poll(&pfd, 1, 100) <= 0)
+                continue;
+            struct sockaddr_in addr;
+            socklen_t addr_len = sizeof(addr);
+            SOCKET s;
+            while ((s = accept(tcp_s, (SOCKADDR *)&addr, &addr_len)) != INVALID_SOCKET)
+            {
+                if (!shard_hand_over(&ch.shards[next], s, &addr))
+                    closesocket(s);
+                next = (next + 1) % num_shards;
+                addr_len = sizeof(addr);
+            }
+        }
+        if (stop_flag)
+            printf("\nCtrl+Z detected. Finalizing logs...\n");
+    }
+
+    atomic_store(&ch.stopping, 1);
+    for (int i = 0; i < started; i++)
+    {
+        shard_wake(&ch.shards[i]);
+        thread_join(ch.shards[i].thread);
+    }
+    for (int i = 0; i < num_shards; i++)
+        shard_free(&ch.shards[i]);
+    free(ch.shards);
+    return ok;
+}
+
+#endif
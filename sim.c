@@ -0,0 +1,270 @@
+#include "header.h"
+#include <math.h>
+
+// Stations behave like server.c: one frame at a time, retried under the backoff policy on
+// every collision and dropped once the policy gives up. A station's next frame arrives a
+// geometric time after the previous one is done, which gives the requested aggregate load
+// while the population is mostly idle.
+//
+// Time runs in ticks of one propagation delay, and a frame lasts frame_ticks. Carrier-sense
+// stations sense at every tick, so a frame is heard from the tick after it starts. Frames that
+// overlap on the medium collide. Slotted ALOHA starts frames on frame-time boundaries, where
+// overlap means starting together, and pure ALOHA starts them at any tick. With collision
+// detection a collided frame is cut off after a round trip. Backoff is counted in frame times,
+// or in round trips with collision detection, as Ethernet does. All stations hear the same
+// outcomes, so one adaptive backlog estimate stands in for every station's copy.
+
+#define CD_ABORT_TICKS 2 // detect the collision and jam: one round trip
+
+typedef enum SimEventType
+{
+    SIM_END = 0, // sorts first, so a frame leaves the medium before anyone senses it
+    SIM_ATTEMPT = 1
+} SimEventType;
+
+typedef struct SimEvent
+{
+    uint64_t key; // tick << 1 | SimEventType
+    uint32_t station;
+} SimEvent;
+
+typedef struct SimStation
+{
+    Rng rng; // stream i of the run's seed, so draws don't depend on event order
+    BackoffState backoff;
+    int collided;        // the frame on the medium has been hit
+    uint64_t first_sent; // tick of the frame's first transmission
+    uint32_t on_air_pos; // index in the on-air list while transmitting
+} SimStation;
+
+// Min-heap of pending events ordered by tick, ends before attempts
+typedef struct SimQueue
+{
+    SimEvent *events;
+    size_t count;
+} SimQueue;
+
+static void queue_push(SimQueue *q, uint64_t tick, SimEventType type, uint32_t station)
+{
+    uint64_t key = tick << 1 | type;
+    size_t i = q->count++;
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (q->events[parent].key <= key)
+            break;
+        q->events[i] = q->events[parent];
+        i = parent;
+    }
+    q->events[i].key = key;
+    q->events[i].station = station;
+}
+
+static SimEvent queue_pop(SimQueue *q)
+{
+    SimEvent top = q->events[0];
+    SimEvent last = q->events[--q->count];
+    size_t i = 0;
+    for (;;)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= q->count)
+            break;
+        if (child + 1 < q->count && q->events[child + 1].key < q->events[child].key)
+            child++;
+        if (last.key <= q->events[child].key)
+            break;
+        q->events[i] = q->events[child];
+        i = child;
+    }
+    if (q->count > 0)
+        q->events[i] = last;
+    return top;
+}
+
+// Ticks until a station's next frame: geometric with per-tick arrival probability p, at least 1
+static uint64_t next_arrival(Rng *rng, double p, double log_q)
+{
+    if (p >= 1.0)
+        return 1;
+    double gap = floor(log(rng_unit(rng)) / log_q);
+    return gap < 1e18 ? 1 + (uint64_t)gap : UINT64_MAX / 4;
+}
+
+// Hold-back the backoff policy puts on a new frame, in ticks
+static uint64_t first_wait(const SimConfig *cfg, const BackoffEstimator *est, Rng *rng, uint64_t unit)
+{
+    return (uint64_t)backoff_first(&cfg->backoff, est, rng) * unit;
+}
+
+// Slotted ALOHA may only start a frame on a frame-time boundary
+static uint64_t align_start(const SimConfig *cfg, uint64_t tick)
+{
+    if (!cfg->mac.slotted || cfg->mac.carrier_sense || cfg->frame_ticks <= 1)
+        return tick;
+    uint64_t f = (uint64_t)cfg->frame_ticks;
+    return (tick + f - 1) / f * f;
+}
+
+int simulate(const SimConfig *cfg, SimResult *res)
+{
+    memset(res, 0, sizeof(SimResult));
+    histogram_init(&res->frame_delay, "Frame delay");
+    res->slots = cfg->slots;
+    if (cfg->stations <= 0 || cfg->slots == 0)
+        return 1;
+
+    SimStation *stations = (SimStation *)calloc(cfg->stations, sizeof(SimStation));
+    SimQueue queue = {(SimEvent *)malloc(cfg->stations * sizeof(SimEvent)), 0};
+    uint32_t *batch = (uint32_t *)malloc(cfg->stations * sizeof(uint32_t));
+    uint32_t *on_air = (uint32_t *)malloc(cfg->stations * sizeof(uint32_t));
+    if (!stations || !queue.events || !batch || !on_air)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(stations);
+        free(queue.events);
+        free(batch);
+        free(on_air);
+        return 0;
+    }
+
+    const MacStrategy *mac = &cfg->mac;
+    uint64_t frame = (uint64_t)(cfg->frame_ticks > 0 ? cfg->frame_ticks : 1);
+    uint64_t end_tick = cfg->slots * frame;
+    uint64_t backoff_unit = mac->collision_detect && frame > CD_ABORT_TICKS ? CD_ABORT_TICKS : frame;
+    uint64_t slot_ns = (uint64_t)(cfg->slot_time > 0 ? cfg->slot_time : 1) * NS_PER_MS;
+    double p = cfg->load / ((double)cfg->stations * (double)frame);
+    if (p > 1.0)
+        p = 1.0;
+    double log_q = p < 1.0 ? log1p(-p) : 0.0;
+
+    if (p > 0.0)
+    {
+        for (int i = 0; i < cfg->stations; i++)
+        {
+            rng_seed(&stations[i].rng, cfg->seed, (uint64_t)i);
+            queue_push(&queue, align_start(cfg, next_arrival(&stations[i].rng, p, log_q) - 1), SIM_ATTEMPT, (uint32_t)i);
+        }
+    }
+
+    uint32_t num_on_air = 0;
+    uint64_t busy_until = 0; // tick the medium clears if nobody else starts
+    uint64_t idle_since = 0;
+    uint64_t idle_ticks = 0;
+    int period_collided = 0; // the current busy period saw a collision
+    BackoffEstimator estimate;
+    backoff_estimator_init(&estimate);
+
+    while (queue.count > 0 && (queue.events[0].key >> 1) < end_tick)
+    {
+        SimEvent ev = queue_pop(&queue);
+        uint64_t now = ev.key >> 1;
+        SimStation *st = &stations[ev.station];
+
+        if ((ev.key & 1) == SIM_END)
+        {
+            // Frame leaves the medium
+            uint32_t last = on_air[--num_on_air];
+            on_air[st->on_air_pos] = last;
+            stations[last].on_air_pos = st->on_air_pos;
+            if (num_on_air == 0)
+            {
+                idle_since = now;
+                if (period_collided)
+                    res->collision_slots++;
+                else
+                    backoff_observe(&estimate, SLOT_SUCCESS, 1);
+                period_collided = 0;
+            }
+
+            if (!st->collided)
+            {
+                res->success_slots++;
+                histogram_record(&res->frame_delay, (now - st->first_sent) * slot_ns / frame);
+                backoff_done(&st->backoff);
+                queue_push(&queue, align_start(cfg, now - 1 + next_arrival(&st->rng, p, log_q) + first_wait(cfg, &estimate, &st->rng, backoff_unit)), SIM_ATTEMPT, ev.station);
+            }
+            else
+            {
+                int wait = backoff_next(&cfg->backoff, &st->backoff, &estimate, &st->rng);
+                if (wait < 0)
+                {
+                    // Give the frame up and wait for the next one
+                    res->dropped++;
+                    backoff_done(&st->backoff);
+                    queue_push(&queue, align_start(cfg, now - 1 + next_arrival(&st->rng, p, log_q) + first_wait(cfg, &estimate, &st->rng, backoff_unit)), SIM_ATTEMPT, ev.station);
+                }
+                else
+                {
+                    queue_push(&queue, align_start(cfg, now + (uint64_t)wait * backoff_unit), SIM_ATTEMPT, ev.station);
+                }
+            }
+            continue;
+        }
+
+        // Every station ready at this tick decides before any of them can be heard
+        int num_batch = 0;
+        int medium_busy = num_on_air > 0;
+        for (;;)
+        {
+            if (mac_transmit_now(mac, medium_busy, &st->rng))
+            {
+                batch[num_batch++] = ev.station;
+            }
+            else
+            {
+                // Busy: look again when the medium clears. Idle but not our turn: next tick.
+                uint64_t retry = medium_busy && busy_until > now ? busy_until : now + 1;
+                queue_push(&queue, retry, SIM_ATTEMPT, ev.station);
+            }
+            if (queue.count == 0 || queue.events[0].key != (now << 1 | SIM_ATTEMPT))
+                break;
+            ev = queue_pop(&queue);
+            st = &stations[ev.station];
+        }
+        if (num_batch == 0)
+            continue;
+
+        if (num_on_air == 0)
+        {
+            idle_ticks += now - idle_since;
+            backoff_observe(&estimate, SLOT_IDLE, (now - idle_since) / frame);
+        }
+        int hit = num_on_air > 0 || num_batch > 1;
+        if (hit)
+        {
+            // Counted when it happens, so the colliders' backoff already sees it
+            if (!period_collided)
+                backoff_observe(&estimate, SLOT_COLLISION, 1);
+            period_collided = 1;
+            for (uint32_t i = 0; i < num_on_air; i++)
+                stations[on_air[i]].collided = 1;
+        }
+        uint64_t duration = hit && mac->collision_detect && frame > CD_ABORT_TICKS ? CD_ABORT_TICKS : frame;
+        for (int i = 0; i < num_batch; i++)
+        {
+            SimStation *sender = &stations[batch[i]];
+            if (sender->backoff.collisions == 0)
+                sender->first_sent = now;
+            sender->collided = hit;
+            sender->on_air_pos = num_on_air;
+            on_air[num_on_air++] = batch[i];
+            queue_push(&queue, now + duration, SIM_END, batch[i]);
+        }
+        if (now + duration > busy_until)
+            busy_until = now + duration;
+        res->attempts += num_batch;
+    }
+    if (num_on_air == 0 && idle_since < end_tick)
+        idle_ticks += end_tick - idle_since;
+
+    res->idle_slots = idle_ticks / frame;
+    res->throughput = (double)res->success_slots / (double)cfg->slots;
+    res->offered_load = (double)res->attempts / (double)cfg->slots;
+
+    free(stations);
+    free(queue.events);
+    free(batch);
+    free(on_air);
+    return 1;
+}
@@ -0,0 +1,63 @@
+#include "header.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc < 5 || argc > 9)
+    {
+        fprintf(stderr, "Usage: %s <stations> <load> <slots> <seed> [slot_time] [backoff] [mac] [frame_ticks]\n", argv[0]);
+        return 1;
+    }
+
+    SimConfig cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.stations = atoi(argv[1]);
+    cfg.load = atof(argv[2]);
+    cfg.slots = strtoull(argv[3], NULL, 10);
+    cfg.seed = strtoull(argv[4], NULL, 10);
+    cfg.slot_time = argc >= 6 ? atoi(argv[5]) : 1;
+    if (!backoff_parse(argc >= 7 ? argv[6] : "beb", &cfg.backoff))
+    {
+        fprintf(stderr, "Unknown backoff policy: %s\n", argv[6]);
+        return 1;
+    }
+    cfg.frame_ticks = argc == 9 ? atoi(argv[8]) : 100;
+    if (!mac_parse(argc >= 8 ? argv[7] : "slotted", &cfg.mac))
+    {
+        fprintf(stderr, "Unknown MAC protocol: %s\n", argv[7]);
+        return 1;
+    }
+    if (cfg.stations <= 0 || cfg.load < 0 || cfg.slots == 0)
+    {
+        fprintf(stderr, "stations and slots must be positive and load non-negative\n");
+        return 1;
+    }
+
+    SimResult *res = (SimResult *)malloc(sizeof(SimResult));
+    if (!res)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    uint64_t start = now_ns();
+    if (!simulate(&cfg, res))
+    {
+        free(res);
+        return 1;
+    }
+    double elapsed = (double)(now_ns() - start) / NS_PER_SEC;
+
+    fprintf(stderr, "\n%s with %s backoff, %d stations, offered %.3f new frames per frame time, %llu frame times\n", cfg.mac.name,
+            cfg.backoff.name, cfg.stations, cfg.load, (unsigned long long)res->slots);
+    fprintf(stderr, "Idle frame times: %llu, delivered frames: %llu, collisions: %llu\n", (unsigned long long)res->idle_slots,
+            (unsigned long long)res->success_slots, (unsigned long long)res->collision_slots);
+    fprintf(stderr, "Transmissions: %llu, dropped frames: %llu\n", (unsigned long long)res->attempts,
+            (unsigned long long)res->dropped);
+    fprintf(stderr, "Throughput S: %.4f, offered load G: %.4f\n", res->throughput, res->offered_load);
+    histogram_print(&res->frame_delay);
+    fprintf(stderr, "Simulated in %.3f seconds (%.2f M slots/s)\n\n", elapsed,
+            elapsed > 0 ? (double)res->slots / elapsed / 1e6 : 0.0);
+
+    free(res);
+    return 0;
+}
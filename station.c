@@ -0,0 +1,361 @@
+#include "header.h"
+
+// Stop-and-wait stations as state machines. Backoffs, carrier-sense retries and echo timeouts
+// are timers on one wheel, and replies are picked up as they arrive, so one thread can drive
+// any number of stations without ever sleeping on one of them.
+
+int station_init(Station *st, SOCKET socket, InputSource *in, const Input *cfg, OutputServer *out, const char *padding, uint64_t stream)
+{
+    memset(st, 0, sizeof(Station));
+    st->socket = socket;
+    st->cfg = cfg;
+    st->in = in;
+    st->out = out;
+    st->latency = out;
+    st->verbose = 1;
+    st->padding = padding;
+    st->timer.owner = st;
+    rng_seed(&st->rng, (uint64_t)cfg->seed, stream);
+    backoff_estimator_init(&st->est);
+    // The local port tells our ACKs and NOISE apart from other stations' on the same host
+    struct sockaddr_in local_addr;
+    socklen_t local_len = sizeof(local_addr);
+    if (getsockname(socket, (struct sockaddr *)&local_addr, &local_len) == 0)
+        st->station_id = ntohs(local_addr.sin_port);
+    st->rx = (char *)malloc(cfg->frame_size + 1);
+    if (!in->map)
+        st->scratch = (char *)malloc(cfg->frame_size);
+    return st->rx && (in->map || st->scratch);
+}
+
+void station_free(Station *st)
+{
+    free(st->rx);
+    free(st->scratch);
+    st->rx = NULL;
+    st->scratch = NULL;
+}
+
+static void station_finish(StationLoop *loop, Station *st, uint64_t now)
+{
+    timer_cancel(&loop->wheel, &st->timer);
+#ifdef __linux__
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, st->socket, NULL);
+#endif
+    st->state = STATION_DONE;
+    st->done_at = now;
+    loop->active--;
+}
+
+static void station_fail(StationLoop *loop, Station *st, uint64_t now)
+{
+    st->out->success = 0;
+    station_finish(loop, st, now);
+}
+
+// Carrier sense, then send if the MAC allows it; otherwise look again one slot later
+static void station_sense(StationLoop *loop, Station *st, uint64_t now)
+{
+    int busy = st->heard;
+    st->heard = 0;
+    if (!mac_transmit_now(&st->cfg->mac, busy, &st->rng))
+    {
+        st->state = STATION_SENSING;
+        timer_schedule(&loop->wheel, &st->timer, now + (uint64_t)st->cfg->slot_time * NS_PER_MS);
+        return;
+    }
+
+    if (send_frame(st->socket, st->header, HEADER_V2_SIZE, st->payload, st->payload_len, st->cfg->frame_size, st->padding) == SOCKET_ERROR)
+    {
+        fprintf(stderr, "Send failed: %d\n", WSAGetLastError());
+        station_fail(loop, st, now);
+        return;
+    }
+    st->sent_at = now;
+    if (st->transmissions == 0)
+        st->first_sent_at = now;
+    st->transmissions++;
+    st->state = STATION_AWAIT_ECHO;
+    timer_schedule(&loop->wheel, &st->timer, now + (uint64_t)st->cfg->timeout * NS_PER_SEC);
+}
+
+// Wait "slots" slots before the next transmission
+static void station_backoff(StationLoop *loop, Station *st, int slots, uint64_t now)
+{
+    st->backoff_from = now;
+    if (slots <= 0)
+    {
+        station_sense(loop, st, now);
+        return;
+    }
+    st->state = STATION_BACKOFF;
+    timer_schedule(&loop->wheel, &st->timer, now + (uint64_t)slots * st->cfg->slot_time * NS_PER_MS);
+}
+
+static void station_next_frame(StationLoop *loop, Station *st, uint64_t now)
+{
+    st->payload = input_next_frame(st->in, st->scratch, st->cfg->frame_size, &st->payload_len);
+    if (!st->payload || stop_flag)
+    {
+        station_finish(loop, st, now); // EOF or error
+        return;
+    }
+    // The header, CRC included, stays the same across retransmissions of the frame
+    int frame_size = st->cfg->frame_size;
+    build_header_v2(st->header, FRAME_DATA | FRAME_COMPACT, st->station_id, ++st->seq, (uint32_t)st->payload_len, (uint32_t)frame_size);
+    header_v2_seal(st->header, frame_crc(st->header, st->payload, st->payload_len, st->padding, frame_size - st->payload_len));
+    st->transmissions = 0;
+    st->backoff_ns = 0;
+    backoff_done(&st->backoff);
+    station_backoff(loop, st, backoff_first(&st->cfg->backoff, &st->est, &st->rng), now);
+}
+
+static void station_collision(StationLoop *loop, Station *st, uint64_t now)
+{
+    backoff_observe(&st->est, SLOT_COLLISION, 1);
+    int wait = backoff_next(&st->cfg->backoff, &st->backoff, &st->est, &st->rng);
+    if (wait < 0)
+    {
+        if (st->verbose)
+            printf("Maximum collisions reached for this frame\n");
+        station_fail(loop, st, now);
+        return;
+    }
+    if (st->verbose)
+        printf("Collision count: %d, transmissions: %d\n", st->backoff.collisions, st->transmissions); // DEBUG
+    station_backoff(loop, st, wait, now);
+}
+
+static void station_on_timer(StationLoop *loop, Station *st, uint64_t now)
+{
+    switch (st->state)
+    {
+    case STATION_BACKOFF:
+        st->backoff_ns += now - st->backoff_from;
+        station_sense(loop, st, now);
+        break;
+    case STATION_SENSING:
+        station_sense(loop, st, now);
+        break;
+    case STATION_AWAIT_ECHO:
+        if (st->verbose)
+            printf("Timeout occurred\n"); // DEBUG
+        station_collision(loop, st, now);
+        break;
+    case STATION_DONE:
+        break;
+    }
+}
+
+// A whole reply has arrived: our ACK or NOISE, or another station's frame. The header alone
+// says which.
+static void station_on_reply(StationLoop *loop, Station *st, const FrameHeader *fh, uint64_t now)
+{
+    int ours = fh->station_id == st->station_id && fh->seq == st->seq;
+    if (fh->flags & FRAME_NOISE)
+    {
+        if (!ours || st->state != STATION_AWAIT_ECHO)
+            return; // late NOISE for a frame that already timed out
+        if (st->verbose)
+            printf("NOISE detected - collision occurred\n"); // DEBUG
+        station_collision(loop, st, now);
+        return;
+    }
+    if (fh->flags & FRAME_ACK)
+    {
+        if (!ours || st->state != STATION_AWAIT_ECHO)
+            return;
+        if (st->verbose)
+            printf("Frame successfully transmitted\n");
+        backoff_observe(&st->est, SLOT_SUCCESS, 1);
+        histogram_record(&st->latency->echo_latency, now - st->sent_at);
+        histogram_record(&st->latency->frame_latency, now - st->first_sent_at);
+        histogram_record(&st->latency->backoff_wait, st->backoff_ns);
+        if (st->transmissions > st->out->max_transmissions)
+            st->out->max_transmissions = st->transmissions;
+        st->total_transmissions += st->transmissions;
+        st->num_frames++;
+        station_next_frame(loop, st, now);
+        return;
+    }
+    // The channel forwards every successful frame to all stations; this one was another station's
+    if (st->state == STATION_AWAIT_ECHO && st->verbose)
+        printf("Received another station's frame, still waiting for ours\n");
+    backoff_observe(&st->est, SLOT_SUCCESS, 1);
+    st->heard = 1;
+}
+
+// The socket is readable: take what one recv() gives without blocking. A reply to our own frame
+// is a single byte; anything else is a frame header, collected first, and a body that is only
+// there to be skipped.
+static void station_on_readable(StationLoop *loop, Station *st, uint64_t now)
+{
+    int header_phase = st->rx_header_got < HEADER_V2_SIZE;
+    int n;
+    if (header_phase)
+        n = recv(st->socket, st->rx_header + st->rx_header_got, HEADER_V2_SIZE - st->rx_header_got, 0);
+    else
+        n = recv(st->socket, st->rx, st->rx_body_left < st->cfg->frame_size ? st->rx_body_left : st->cfg->frame_size, 0);
+    if (n <= 0)
+    {
+        if (n == 0)
+            fprintf(stderr, "Channel closed the connection\n");
+        else
+            fprintf(stderr, "Receive failed with error code: %d\n", WSAGetLastError());
+        station_fail(loop, st, now);
+        return;
+    }
+
+    FrameHeader fh;
+    if (header_phase)
+    {
+        st->rx_header_got += n;
+        // One-byte replies only ever arrive between frames, so they can only open the buffer
+        while (st->rx_header_got > 0 && ((uint8_t)st->rx_header[0] == COMPACT_ACK || (uint8_t)st->rx_header[0] == COMPACT_NOISE))
+        {
+            memset(&fh, 0, sizeof(fh));
+            fh.flags = (uint8_t)st->rx_header[0] == COMPACT_ACK ? FRAME_ACK : FRAME_NOISE;
+            fh.station_id = st->station_id;
+            fh.seq = st->seq;
+            st->rx_header_got--;
+            memmove(st->rx_header, st->rx_header + 1, st->rx_header_got);
+            station_on_reply(loop, st, &fh, now);
+            if (st->state == STATION_DONE)
+                return;
+        }
+        if (st->rx_header_got < HEADER_V2_SIZE)
+            return;
+        if (!header_v2_parse(st->rx_header, &fh) || fh.body_len > MAX_FRAME_SIZE)
+        {
+            fprintf(stderr, "Malformed reply from the channel\n");
+            station_fail(loop, st, now);
+            return;
+        }
+        st->rx_body_left = (int)fh.body_len;
+    }
+    else
+    {
+        st->rx_body_left -= n;
+        header_v2_parse(st->rx_header, &fh);
+    }
+    if (st->rx_body_left > 0)
+        return;
+    st->rx_header_got = 0;
+    station_on_reply(loop, st, &fh, now);
+}
+
+// Run the stations until each has sent its input, failed, or Ctrl+C was pressed. Returns 0 if
+// the loop itself could not be set up.
+int station_loop_run(Station *stations, int count)
+{
+    StationLoop loop;
+    timer_wheel_init(&loop.wheel, now_ns(), NS_PER_MS);
+    loop.active = count;
+#ifdef __linux__
+    loop.epfd = epoll_create1(0);
+    if (loop.epfd < 0)
+    {
+        fprintf(stderr, "epoll_create1 failed: %d\n", errno);
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN; // level-triggered: one recv() per wakeup, the rest is reported again
+        ev.data.ptr = &stations[i];
+        epoll_ctl(loop.epfd, EPOLL_CTL_ADD, stations[i].socket, &ev);
+    }
+    struct epoll_event events[MAX_EVENTS];
+#endif
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < count; i++)
+        station_next_frame(&loop, &stations[i], start);
+
+    while (loop.active > 0 && !stop_flag)
+    {
+        uint64_t now = now_ns();
+        Timer *timer = timer_wheel_expire(&loop.wheel, now);
+        while (timer)
+        {
+            Timer *next = timer->next; // the handler may re-arm it
+            station_on_timer(&loop, (Station *)timer->owner, now);
+            timer = next;
+        }
+        if (loop.active == 0)
+            break;
+
+        // Sleep until the next timer, waking at least once a second to notice Ctrl+C
+        uint64_t next_ns = timer_wheel_next(&loop.wheel);
+        now = now_ns();
+        uint64_t wait_ns = next_ns > now ? next_ns - now : 0;
+        if (wait_ns > NS_PER_SEC)
+            wait_ns = NS_PER_SEC;
+#ifdef __linux__
+        int ready = epoll_wait(loop.epfd, events, MAX_EVENTS, (int)((wait_ns + NS_PER_MS - 1) / NS_PER_MS));
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "epoll_wait failed: %d\n", errno);
+            break;
+        }
+        now = now_ns();
+        for (int i = 0; i < ready; i++)
+        {
+            Station *st = (Station *)events[i].data.ptr;
+            if (st->state != STATION_DONE)
+                station_on_readable(&loop, st, now);
+        }
+#else
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        SOCKET max_fd = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (stations[i].state == STATION_DONE)
+                continue;
+            FD_SET(stations[i].socket, &read_fds);
+            if (stations[i].socket > max_fd)
+                max_fd = stations[i].socket;
+        }
+        struct timeval tv;
+        tv.tv_sec = (long)(wait_ns / NS_PER_SEC);
+        tv.tv_usec = (long)((wait_ns % NS_PER_SEC + 999) / 1000);
+        int ready = select((int)max_fd + 1, &read_fds, NULL, NULL, &tv);
+        if (ready == SOCKET_ERROR)
+        {
+#ifndef _WIN32
+            if (errno == EINTR)
+                continue;
+#endif
+            fprintf(stderr, "Select failed: %d\n", WSAGetLastError());
+            break;
+        }
+        now = now_ns();
+        for (int i = 0; i < count && ready > 0; i++)
+        {
+            if (stations[i].state != STATION_DONE && FD_ISSET(stations[i].socket, &read_fds))
+                station_on_readable(&loop, &stations[i], now);
+        }
+#endif
+    }
+
+#ifdef __linux__
+    close(loop.epfd);
+#endif
+    return 1;
+}
+
+#ifdef _WIN32
+BOOL WINAPI ctrl_handler(DWORD ctrl_type)
+{
+    if (ctrl_type == CTRL_C_EVENT)
+    {
+        stop_flag = 1;
+        return TRUE;
+    }
+    return FALSE;
+}
+#endif
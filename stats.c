@@ -0,0 +1,107 @@
+#include "header.h"
+
+// Log-linear bucketing as in HdrHistogram: values below HIST_SUB_BUCKETS get one bucket each,
+// larger values keep their top HIST_SUB_BITS bits, so every bucket is within 1/64 (~1.6%) of
+// the values it holds over the whole 64-bit range.
+
+static int highest_bit(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1)
+        bit++;
+    return bit;
+#endif
+}
+
+static int bucket_index(uint64_t value)
+{
+    if (value < HIST_SUB_BUCKETS)
+        return (int)value;
+    int shift = highest_bit(value) - (HIST_SUB_BITS - 1);
+    int mantissa = (int)(value >> shift); // in [HIST_SUB_BUCKETS / 2, HIST_SUB_BUCKETS)
+    return HIST_SUB_BUCKETS + (shift - 1) * (HIST_SUB_BUCKETS / 2) + (mantissa - HIST_SUB_BUCKETS / 2);
+}
+
+// Largest value that falls into bucket i
+static uint64_t bucket_high(int i)
+{
+    if (i < HIST_SUB_BUCKETS)
+        return (uint64_t)i;
+    int shift = (i - HIST_SUB_BUCKETS) / (HIST_SUB_BUCKETS / 2) + 1;
+    uint64_t mantissa = (uint64_t)((i - HIST_SUB_BUCKETS) % (HIST_SUB_BUCKETS / 2) + HIST_SUB_BUCKETS / 2);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void histogram_init(LatencyHistogram *hist, const char *name)
+{
+    memset(hist, 0, sizeof(LatencyHistogram));
+    hist->name = name;
+    hist->min = UINT64_MAX;
+}
+
+void histogram_record(LatencyHistogram *hist, uint64_t value_ns)
+{
+    hist->counts[bucket_index(value_ns)]++;
+    hist->total++;
+    if (value_ns < hist->min)
+        hist->min = value_ns;
+    if (value_ns > hist->max)
+        hist->max = value_ns;
+}
+
+// Smallest recorded value such that at least percentile% of the samples are at or below it
+uint64_t histogram_percentile(const LatencyHistogram *hist, double percentile)
+{
+    if (hist->total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)hist->total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t high = bucket_high(i);
+            return high < hist->max ? high : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+void histogram_print(const LatencyHistogram *hist)
+{
+    if (hist->total == 0)
+    {
+        fprintf(stderr, "%s: no samples\n", hist->name);
+        return;
+    }
+    fprintf(stderr, "%s (ms): p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n", hist->name,
+            (double)histogram_percentile(hist, 50.0) / NS_PER_MS,
+            (double)histogram_percentile(hist, 90.0) / NS_PER_MS,
+            (double)histogram_percentile(hist, 99.0) / NS_PER_MS,
+            (double)histogram_percentile(hist, 99.9) / NS_PER_MS,
+            (double)hist->max / NS_PER_MS);
+}
+
+// Append the non-empty buckets as "<upper bound in us> <count> <cumulative fraction>" lines
+// under a "# name" heading, in the spirit of HdrHistogram's percentile distribution output
+void histogram_dump(const LatencyHistogram *hist, FILE *f)
+{
+    fprintf(f, "# %s: %llu samples\n", hist->name, (unsigned long long)hist->total);
+    fprintf(f, "# value_us count fraction\n");
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS && seen < hist->total; i++)
+    {
+        if (hist->counts[i] == 0)
+            continue;
+        seen += hist->counts[i];
+        fprintf(f, "%.3f %llu %.6f\n", (double)bucket_high(i) / 1000.0,
+                (unsigned long long)hist->counts[i], (double)seen / (double)hist->total);
+    }
+    fprintf(f, "\n");
+}
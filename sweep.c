@@ -0,0 +1,377 @@
+#include "header.h"
+
+// Monte Carlo sweep over mac x backoff x stations x load x frame_size x slot_time x runs. Every grid point is
+// an independent simulate() call. Workers start with an equal share of the points and, once
+// their own share is done, steal the upper half of the largest share left on another worker.
+// Each point's RNG stream is derived from the base seed and the point index, so results do
+// not depend on the thread count or on which worker ran the point.
+
+#define SWEEP_FRAME_TICKS 100 // frame time over propagation delay
+
+typedef struct SweepList
+{
+    double *values;
+    int count;
+} SweepList;
+
+typedef struct SweepRow
+{
+    const char *mac;
+    const char *backoff;
+    int stations;
+    double load;
+    int frame_size;
+    int slot_time;
+    int run;
+    uint64_t seed;
+    double throughput;
+    double offered_load;
+    uint64_t idle_slots;
+    uint64_t success_slots;
+    uint64_t collision_slots;
+    uint64_t dropped;
+    double delay_p50_ms;
+    double delay_p99_ms;
+    double bandwidth_mbps; // successful payload bits over simulated time
+} SweepRow;
+
+typedef struct SweepWorker
+{
+    mutex_t lock;
+    size_t begin; // points [begin, end) still belong to this worker
+    size_t end;
+    thread_t thread;
+    struct SweepPool *pool;
+    int id;
+} SweepWorker;
+
+typedef struct SweepPool
+{
+    SweepList stations, loads, frame_sizes, slot_times;
+    MacStrategy *macs;
+    int num_macs;
+    BackoffPolicy *backoffs;
+    int num_backoffs;
+    int runs;
+    uint64_t slots;
+    uint64_t seed;
+    SweepRow *rows;
+    size_t num_points;
+    SweepWorker *workers;
+    int num_workers;
+} SweepPool;
+
+// Parse "pure,csma:0.1,..." into MAC strategies
+static int parse_macs(char *arg, SweepPool *pool)
+{
+    int count = 1;
+    for (const char *p = arg; *p; p++)
+        count += *p == ',';
+    pool->macs = (MacStrategy *)malloc(count * sizeof(MacStrategy));
+    if (!pool->macs)
+        return 0;
+    pool->num_macs = 0;
+    for (char *name = strtok(arg, ","); name; name = strtok(NULL, ","))
+    {
+        if (!mac_parse(name, &pool->macs[pool->num_macs]))
+        {
+            fprintf(stderr, "Unknown MAC protocol: %s\n", name);
+            return 0;
+        }
+        pool->num_macs++;
+    }
+    return pool->num_macs > 0;
+}
+
+// Parse "beb:10:16,adaptive,..." into backoff policies
+static int parse_backoffs(char *arg, SweepPool *pool)
+{
+    int count = 1;
+    for (const char *p = arg; *p; p++)
+        count += *p == ',';
+    pool->backoffs = (BackoffPolicy *)malloc(count * sizeof(BackoffPolicy));
+    if (!pool->backoffs)
+        return 0;
+    pool->num_backoffs = 0;
+    for (char *name = strtok(arg, ","); name; name = strtok(NULL, ","))
+    {
+        if (!backoff_parse(name, &pool->backoffs[pool->num_backoffs]))
+        {
+            fprintf(stderr, "Unknown backoff policy: %s\n", name);
+            return 0;
+        }
+        pool->num_backoffs++;
+    }
+    return pool->num_backoffs > 0;
+}
+
+// Parse "a,b,c" into a list of numbers
+static int parse_list(const char *arg, SweepList *list)
+{
+    int count = 1;
+    for (const char *p = arg; *p; p++)
+        count += *p == ',';
+    list->values = (double *)malloc(count * sizeof(double));
+    if (!list->values)
+        return 0;
+    list->count = 0;
+    const char *p = arg;
+    while (*p)
+    {
+        char *end;
+        double v = strtod(p, &end);
+        if (end == p)
+            return 0;
+        list->values[list->count++] = v;
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return 0;
+    }
+    return list->count > 0;
+}
+
+static void run_point(SweepPool *pool, size_t index, SimResult *res)
+{
+    SweepRow *row = &pool->rows[index];
+    size_t i = index;
+    row->run = (int)(i % pool->runs);
+    i /= pool->runs;
+    row->slot_time = (int)pool->slot_times.values[i % pool->slot_times.count];
+    i /= pool->slot_times.count;
+    row->frame_size = (int)pool->frame_sizes.values[i % pool->frame_sizes.count];
+    i /= pool->frame_sizes.count;
+    row->load = pool->loads.values[i % pool->loads.count];
+    i /= pool->loads.count;
+    row->stations = (int)pool->stations.values[i % pool->stations.count];
+    i /= pool->stations.count;
+    const BackoffPolicy *backoff = &pool->backoffs[i % pool->num_backoffs];
+    row->backoff = backoff->name;
+    i /= pool->num_backoffs;
+    const MacStrategy *mac = &pool->macs[i];
+    row->mac = mac->name;
+
+    uint64_t state = pool->seed + index * 0x9E3779B97F4A7C15ULL;
+    row->seed = splitmix64(&state);
+
+    SimConfig cfg;
+    cfg.stations = row->stations;
+    cfg.load = row->load;
+    cfg.slots = pool->slots;
+    cfg.seed = row->seed;
+    cfg.slot_time = row->slot_time;
+    cfg.backoff = *backoff;
+    cfg.mac = *mac;
+    cfg.frame_ticks = SWEEP_FRAME_TICKS;
+    if (!simulate(&cfg, res))
+        return;
+
+    row->throughput = res->throughput;
+    row->offered_load = res->offered_load;
+    row->idle_slots = res->idle_slots;
+    row->success_slots = res->success_slots;
+    row->collision_slots = res->collision_slots;
+    row->dropped = res->dropped;
+    row->delay_p50_ms = (double)histogram_percentile(&res->frame_delay, 50.0) / NS_PER_MS;
+    row->delay_p99_ms = (double)histogram_percentile(&res->frame_delay, 99.0) / NS_PER_MS;
+    row->bandwidth_mbps = res->throughput * row->frame_size * 8 / (row->slot_time * 1000.0);
+}
+
+// Take the next point of our own share, or steal half of someone else's
+static int next_point(SweepWorker *self, size_t *index)
+{
+    SweepPool *pool = self->pool;
+    for (;;)
+    {
+        mutex_lock(&self->lock);
+        if (self->begin < self->end)
+        {
+            *index = self->begin++;
+            mutex_unlock(&self->lock);
+            return 1;
+        }
+        mutex_unlock(&self->lock);
+
+        SweepWorker *victim = NULL;
+        size_t most = 0;
+        for (int i = 1; i < pool->num_workers; i++)
+        {
+            SweepWorker *w = &pool->workers[(self->id + i) % pool->num_workers];
+            size_t left = w->end - w->begin; // racy read, only used to pick a victim
+            if (w->begin < w->end && left > most)
+            {
+                most = left;
+                victim = w;
+            }
+        }
+        if (!victim)
+            return 0;
+
+        mutex_lock(&victim->lock);
+        size_t left = victim->end > victim->begin ? victim->end - victim->begin : 0;
+        size_t from = victim->begin + left / 2, to = victim->end;
+        if (left > 0)
+            victim->end = from;
+        mutex_unlock(&victim->lock);
+        if (left == 0)
+            continue; // drained in the meantime, look again
+
+        mutex_lock(&self->lock);
+        self->begin = from;
+        self->end = to;
+        mutex_unlock(&self->lock);
+    }
+}
+
+static thread_ret_t THREAD_CALL sweep_worker(void *param)
+{
+    SweepWorker *self = (SweepWorker *)param;
+    SimResult *res = (SimResult *)malloc(sizeof(SimResult)); // scratch, the histogram is large
+    if (!res)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    size_t index;
+    while (next_point(self, &index))
+        run_point(self->pool, index, res);
+    free(res);
+    return 0;
+}
+
+static void write_csv(const SweepPool *pool, FILE *f)
+{
+    fprintf(f, "mac,backoff,stations,load,frame_size,slot_time,run,seed,throughput,offered_load,idle_slots,success_slots,"
+               "collision_slots,dropped,delay_p50_ms,delay_p99_ms,bandwidth_mbps\n");
+    for (size_t i = 0; i < pool->num_points; i++)
+    {
+        const SweepRow *r = &pool->rows[i];
+        fprintf(f, "%s,%s,%d,%g,%d,%d,%d,%llu,%.6f,%.6f,%llu,%llu,%llu,%llu,%.3f,%.3f,%.6f\n", r->mac, r->backoff, r->stations, r->load,
+                r->frame_size, r->slot_time, r->run, (unsigned long long)r->seed, r->throughput,
+                r->offered_load, (unsigned long long)r->idle_slots,
+                (unsigned long long)r->success_slots, (unsigned long long)r->collision_slots,
+                (unsigned long long)r->dropped, r->delay_p50_ms, r->delay_p99_ms, r->bandwidth_mbps);
+    }
+}
+
+static void write_json(const SweepPool *pool, FILE *f)
+{
+    fprintf(f, "[\n");
+    for (size_t i = 0; i < pool->num_points; i++)
+    {
+        const SweepRow *r = &pool->rows[i];
+        fprintf(f, "  {\"mac\": \"%s\", \"backoff\": \"%s\", \"stations\": %d, \"load\": %g, \"frame_size\": %d, \"slot_time\": %d, \"run\": %d, "
+                   "\"seed\": %llu, \"throughput\": %.6f, \"offered_load\": %.6f, \"idle_slots\": %llu, "
+                   "\"success_slots\": %llu, \"collision_slots\": %llu, \"dropped\": %llu, "
+                   "\"delay_p50_ms\": %.3f, \"delay_p99_ms\": %.3f, \"bandwidth_mbps\": %.6f}%s\n",
+                r->mac, r->backoff, r->stations, r->load, r->frame_size, r->slot_time, r->run, (unsigned long long)r->seed,
+                r->throughput, r->offered_load, (unsigned long long)r->idle_slots,
+                (unsigned long long)r->success_slots, (unsigned long long)r->collision_slots,
+                (unsigned long long)r->dropped, r->delay_p50_ms, r->delay_p99_ms, r->bandwidth_mbps,
+                i + 1 < pool->num_points ? "," : "");
+    }
+    fprintf(f, "]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 8 || argc > 12)
+    {
+        fprintf(stderr, "Usage: %s <stations> <loads> <frame_sizes> <slot_times> <runs> <slots> <seed> [threads] [out_file|-] [macs] [backoffs]\n", argv[0]);
+        fprintf(stderr, "List arguments are comma-separated, e.g. 10,100,1000, pure,slotted,csma:0.1,csma-cd or beb:10:16,jitter,adaptive. out_file ending in .json gets JSON, anything else CSV.\n");
+        return 1;
+    }
+
+    SweepPool pool;
+    memset(&pool, 0, sizeof(pool));
+    if (!parse_list(argv[1], &pool.stations) || !parse_list(argv[2], &pool.loads) ||
+        !parse_list(argv[3], &pool.frame_sizes) || !parse_list(argv[4], &pool.slot_times))
+    {
+        fprintf(stderr, "Invalid list argument\n");
+        return 1;
+    }
+    pool.runs = atoi(argv[5]);
+    pool.slots = strtoull(argv[6], NULL, 10);
+    pool.seed = strtoull(argv[7], NULL, 10);
+    pool.num_workers = argc >= 9 && atoi(argv[8]) > 0 ? atoi(argv[8]) : cpu_count();
+    const char *out_file = argc >= 10 && strcmp(argv[9], "-") != 0 ? argv[9] : NULL;
+    char default_macs[] = "slotted";
+    char default_backoffs[] = "beb";
+    if (!parse_macs(argc >= 11 ? argv[10] : default_macs, &pool) ||
+        !parse_backoffs(argc == 12 ? argv[11] : default_backoffs, &pool))
+        return 1;
+    if (pool.runs <= 0 || pool.slots == 0)
+    {
+        fprintf(stderr, "runs and slots must be positive\n");
+        return 1;
+    }
+
+    pool.num_points = (size_t)pool.num_macs * pool.num_backoffs * pool.stations.count * pool.loads.count * pool.frame_sizes.count *
+                      pool.slot_times.count * pool.runs;
+    if ((size_t)pool.num_workers > pool.num_points)
+        pool.num_workers = (int)pool.num_points;
+    pool.rows = (SweepRow *)calloc(pool.num_points, sizeof(SweepRow));
+    pool.workers = (SweepWorker *)calloc(pool.num_workers, sizeof(SweepWorker));
+    if (!pool.rows || !pool.workers)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < pool.num_workers; i++)
+    {
+        SweepWorker *w = &pool.workers[i];
+        mutex_init(&w->lock);
+        w->pool = &pool;
+        w->id = i;
+        w->begin = pool.num_points * i / pool.num_workers;
+        w->end = pool.num_points * (i + 1) / pool.num_workers;
+    }
+    int started = 0;
+    for (; started < pool.num_workers; started++)
+    {
+        if (!thread_start(&pool.workers[started].thread, sweep_worker, &pool.workers[started]))
+        {
+            // The threads that did start steal the remaining shares
+            fprintf(stderr, "Failed to start worker %d\n", started);
+            break;
+        }
+    }
+    if (started == 0)
+        sweep_worker(&pool.workers[0]);
+    for (int i = 0; i < started; i++)
+        thread_join(pool.workers[i].thread);
+    double elapsed = (double)(now_ns() - start) / NS_PER_SEC;
+
+    FILE *f = stdout;
+    if (out_file)
+    {
+        f = fopen(out_file, "w");
+        if (!f)
+        {
+            fprintf(stderr, "Failed to open output file: %s\n", out_file);
+            return 1;
+        }
+    }
+    size_t name_len = out_file ? strlen(out_file) : 0;
+    if (name_len > 5 && strcmp(out_file + name_len - 5, ".json") == 0)
+        write_json(&pool, f);
+    else
+        write_csv(&pool, f);
+    if (out_file)
+        fclose(f);
+
+    fprintf(stderr, "%zu points on %d threads in %.3f seconds\n", pool.num_points, pool.num_workers, elapsed);
+
+    for (int i = 0; i < pool.num_workers; i++)
+        mutex_destroy(&pool.workers[i].lock);
+    free(pool.workers);
+    free(pool.rows);
+    free(pool.stations.values);
+    free(pool.loads.values);
+    free(pool.frame_sizes.values);
+    free(pool.slot_times.values);
+    free(pool.macs);
+    free(pool.backoffs);
+    return 0;
+}
@@ -145,6 +145,134 @@ int test_single_packet(int port) {
     return 1;
 }
 
+// Test that a frame delivered in small pieces is reassembled before it is forwarded
+int test_fragmented_frame(int port) {
+    SOCKET sock;
+    struct sockaddr_in server_addr;
+    char payload[100] = "This frame arrives a few bytes at a time";
+    char packet[18 + 100] = {0};
+    char received[100] = {0};
+
+    printf("Testing fragmented header and payload...\n");
+
+    memcpy(packet, "\xAA\xBB\xCC\xDD\xEE\xFF", 6);
+    memcpy(packet + 6, "\x11\x22\x33\x44\x55\x66", 6);
+    packet[12] = 0x08;
+    packet[13] = 0x01;
+    packet[16] = (100 >> 8) & 0xFF;
+    packet[17] = 100 & 0xFF;
+    memcpy(packet + 18, payload, sizeof(payload));
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (!is_socket_valid(sock)) return 0;
+
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    server_addr.sin_port = htons(port);
+
+    if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
+        printf("Connection failed: %d\n", WSAGetLastError());
+        closesocket(sock);
+        return 0;
+    }
+
+    int timeout = 2000; // 2 seconds
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    BOOL nodelay = TRUE;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+
+    // 7-byte pieces split the header across three sends and the payload across many more
+    for (int offset = 0; offset < (int)sizeof(packet); offset += 7) {
+        int chunk = sizeof(packet) - offset < 7 ? sizeof(packet) - offset : 7;
+        if (send(sock, packet + offset, chunk, 0) == SOCKET_ERROR) {
+            printf("Send failed: %d\n", WSAGetLastError());
+            closesocket(sock);
+            return 0;
+        }
+        Sleep(5);
+    }
+
+    int bytes_received = recv(sock, received, sizeof(received), MSG_WAITALL);
+    if (bytes_received != sizeof(received) || memcmp(received, payload, sizeof(payload)) != 0) {
+        printf("Reassembled frame mismatch\n");
+        closesocket(sock);
+        return 0;
+    }
+
+    printf("Fragmented frame test PASSED\n");
+    closesocket(sock);
+    return 1;
+}
+
+// Test that a connected but idle station does not turn a lone transmission into a collision
+int test_idle_station_no_collision(int port) {
+    SOCKET sender, idle;
+    struct sockaddr_in server_addr;
+    char payload[100] = "Only one station sends in this slot";
+    char packet[18 + 100] = {0};
+    char received[100] = {0};
+
+    printf("Testing single sender with an idle station connected...\n");
+
+    memcpy(packet, "\xAA\xBB\xCC\xDD\xEE\xFF", 6);
+    memcpy(packet + 6, "\x11\x22\x33\x44\x55\x66", 6);
+    packet[12] = 0x08;
+    packet[13] = 0x01;
+    packet[16] = (100 >> 8) & 0xFF;
+    packet[17] = 100 & 0xFF;
+    memcpy(packet + 18, payload, sizeof(payload));
+
+    sender = socket(AF_INET, SOCK_STREAM, 0);
+    idle = socket(AF_INET, SOCK_STREAM, 0);
+    if (!is_socket_valid(sender) || !is_socket_valid(idle)) {
+        if (sender != INVALID_SOCKET) closesocket(sender);
+        if (idle != INVALID_SOCKET) closesocket(idle);
+        return 0;
+    }
+
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    server_addr.sin_port = htons(port);
+
+    if (connect(sender, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR ||
+        connect(idle, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
+        printf("Connection failed\n");
+        closesocket(sender);
+        closesocket(idle);
+        return 0;
+    }
+
+    int timeout = 2000; // 2 seconds
+    setsockopt(sender, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    setsockopt(idle, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+    if (send(sender, packet, sizeof(packet), 0) == SOCKET_ERROR) {
+        printf("Send failed: %d\n", WSAGetLastError());
+        closesocket(sender);
+        closesocket(idle);
+        return 0;
+    }
+
+    // Both stations should hear the frame, and neither should hear noise
+    int ok = 1;
+    int bytes_received = recv(sender, received, sizeof(received), MSG_WAITALL);
+    if (bytes_received != sizeof(received) || memcmp(received, payload, sizeof(payload)) != 0) {
+        printf("Sender did not get its frame back\n");
+        ok = 0;
+    }
+    memset(received, 0, sizeof(received));
+    bytes_received = recv(idle, received, sizeof(received), MSG_WAITALL);
+    if (bytes_received != sizeof(received) || memcmp(received, payload, sizeof(payload)) != 0) {
+        printf("Idle station did not get the broadcast\n");
+        ok = 0;
+    }
+
+    if (ok) printf("Idle station test PASSED\n");
+    closesocket(sender);
+    closesocket(idle);
+    return ok;
+}
+
 // Test for collision handling (two clients sending simultaneously)
 void test_collision_detection(int port) {
     SOCKET sock1, sock2;
@@ -324,6 +452,18 @@ int main() {
         return 1;
     }
     
+    if (!test_fragmented_frame(port)) {
+        printf("Fragmented frame test FAILED\n");
+        WSACleanup();
+        return 1;
+    }
+
+    if (!test_idle_station_no_collision(port)) {
+        printf("Idle station test FAILED\n");
+        WSACleanup();
+        return 1;
+    }
+
     test_collision_detection(port);
     
     test_connection_limit(port);
@@ -0,0 +1,151 @@
+/**
+ * test_stats.c - Test program for the latency histograms in stats.c
+ *
+ * This program records known samples and compares the histogram's answers
+ * with the exact ones worked out from the sorted samples. It checks that:
+ * 1. Values below HIST_SUB_BUCKETS come back exactly
+ * 2. Larger values come back no lower than the exact percentile and no more
+ *    than 1/64 of it higher, over the whole 64-bit range
+ * 3. The count, minimum and maximum are exact, and no percentile passes
+ *    the maximum
+ */
+
+#include "header.h"
+
+#define NUM_SAMPLES 200000
+
+static const double percentiles[] = {0.0, 1.0, 25.0, 50.0, 90.0, 99.0, 99.9, 99.99, 100.0};
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Exact percentile of sorted samples, ranked the way histogram_percentile() ranks them
+static uint64_t exact_percentile(const uint64_t *sorted, size_t n, double percentile) {
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)n + 0.5);
+    if (rank < 1)
+        rank = 1;
+    return sorted[rank - 1];
+}
+
+// Record the samples, then check every percentile against the exact one within the bucket precision
+static int check_samples(const char *what, uint64_t *samples, size_t n) {
+    static LatencyHistogram hist;
+
+    histogram_init(&hist, what);
+    for (size_t i = 0; i < n; i++)
+        histogram_record(&hist, samples[i]);
+    qsort(samples, n, sizeof(uint64_t), compare_u64);
+
+    if (hist.total != n || hist.min != samples[0] || hist.max != samples[n - 1]) {
+        printf("%s: count, min or max is off\n", what);
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        uint64_t exact = exact_percentile(samples, n, percentiles[i]);
+        uint64_t got = histogram_percentile(&hist, percentiles[i]);
+        uint64_t slack = exact < HIST_SUB_BUCKETS ? 0 : exact / (HIST_SUB_BUCKETS / 2);
+        if (got < exact || got - exact > slack || got > hist.max) {
+            printf("%s: p%g is %llu, exact %llu\n", what, percentiles[i],
+                   (unsigned long long)got, (unsigned long long)exact);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Test small values, which each have a bucket of their own
+int test_small_values() {
+    static uint64_t samples[NUM_SAMPLES];
+    Rng rng;
+
+    printf("Testing small values...\n");
+    rng_seed(&rng, 5, 1);
+    for (size_t i = 0; i < NUM_SAMPLES; i++)
+        samples[i] = rng_below(&rng, HIST_SUB_BUCKETS);
+    if (!check_samples("small", samples, NUM_SAMPLES))
+        return 0;
+    printf("Small value test PASSED\n");
+    return 1;
+}
+
+// Test values spread evenly over the orders of magnitude, up to the largest 64-bit value
+int test_wide_range() {
+    static uint64_t samples[NUM_SAMPLES];
+    Rng rng;
+
+    printf("Testing values across the 64-bit range...\n");
+    rng_seed(&rng, 6, 1);
+    for (size_t i = 0; i < NUM_SAMPLES; i++) {
+        int bits = 1 + (int)rng_below(&rng, 64);
+        samples[i] = rng_next(&rng) >> (64 - bits);
+    }
+    samples[0] = UINT64_MAX;
+    if (!check_samples("wide", samples, NUM_SAMPLES))
+        return 0;
+    printf("Wide range test PASSED\n");
+    return 1;
+}
+
+// Test values either side of every power of two, where the bucket width doubles
+int test_bucket_edges() {
+    static uint64_t samples[3 * 64];
+    size_t n = 0;
+
+    printf("Testing bucket edges...\n");
+    for (int bit = 0; bit < 64; bit++) {
+        uint64_t edge = (uint64_t)1 << bit;
+        samples[n++] = edge - 1;
+        samples[n++] = edge;
+        samples[n++] = edge + 1;
+    }
+    if (!check_samples("edges", samples, n))
+        return 0;
+    // Every sample alone must also come back as itself, to within its bucket
+    for (size_t i = 0; i < n; i++) {
+        if (!check_samples("edge", &samples[i], 1))
+            return 0;
+    }
+    printf("Bucket edge test PASSED\n");
+    return 1;
+}
+
+// Test that an empty histogram answers 0
+int test_empty() {
+    static LatencyHistogram hist;
+
+    printf("Testing an empty histogram...\n");
+    histogram_init(&hist, "empty");
+    if (histogram_percentile(&hist, 50.0) != 0 || hist.total != 0) {
+        printf("Empty histogram has a percentile\n");
+        return 0;
+    }
+    printf("Empty histogram test PASSED\n");
+    return 1;
+}
+
+int main() {
+    printf("=== Latency Histogram Test Suite ===\n\n");
+
+    if (!test_small_values()) {
+        printf("Small value test FAILED\n");
+        return 1;
+    }
+    if (!test_wide_range()) {
+        printf("Wide range test FAILED\n");
+        return 1;
+    }
+    if (!test_bucket_edges()) {
+        printf("Bucket edge test FAILED\n");
+        return 1;
+    }
+    if (!test_empty()) {
+        printf("Empty histogram test FAILED\n");
+        return 1;
+    }
+
+    printf("\nAll tests passed\n");
+    return 0;
+}
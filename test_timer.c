@@ -0,0 +1,209 @@
+/**
+ * test_timer.c - Test program for the timer wheel in timer.c
+ *
+ * This program arms timers on a wheel whose ticks are driven by hand, so
+ * no clock or sockets are involved. It checks that:
+ * 1. Every timer fires exactly once, at its due tick, with the wheel
+ *    advanced one tick at a time
+ * 2. Cancelled timers never fire and re-armed ones fire at the new time
+ * 3. This holds for due ticks on either side of each level boundary,
+ *    beyond the span of the wheel, and for timers armed mid-run
+ * 4. timer_wheel_next() never skips a due timer when the wheel is
+ *    advanced straight to it
+ */
+
+#include "header.h"
+
+#define TICK_NS 1000
+#define ORIGIN_NS 123456
+#define MAX_TIMERS 4000
+
+typedef struct TestTimer {
+    Timer timer;
+    uint64_t due; // tick the timer must fire at
+    int armed;
+    int fired;
+} TestTimer;
+
+static TestTimer timers[MAX_TIMERS];
+static int num_timers;
+
+// Arm t to fire at tick due, anywhere within the tick before it since expiry rounds up
+static void arm(TimerWheel *wheel, TestTimer *t, uint64_t due, Rng *rng) {
+    t->timer.owner = t;
+    t->due = due;
+    t->armed = 1;
+    timer_schedule(wheel, &t->timer, ORIGIN_NS + due * TICK_NS - rng_below(rng, TICK_NS));
+}
+
+// Arm timers at now + delta for deltas either side of each level boundary and past the wheel,
+// and count more at random deltas below each level's span
+static void arm_batch(TimerWheel *wheel, uint64_t now, int count, Rng *rng) {
+    uint64_t deltas[4 * WHEEL_LEVELS];
+    int n = 0;
+    for (int level = 1; level <= WHEEL_LEVELS; level++) {
+        uint64_t boundary = (uint64_t)1 << (WHEEL_BITS * level);
+        deltas[n++] = boundary - 1;
+        deltas[n++] = boundary;
+        deltas[n++] = boundary + 1;
+        deltas[n++] = 2 * boundary + 1;
+    }
+    for (int i = 0; i < n && num_timers < MAX_TIMERS; i++)
+        arm(wheel, &timers[num_timers++], now + deltas[i], rng);
+    for (int i = 0; i < count && num_timers < MAX_TIMERS; i++) {
+        int bits = WHEEL_BITS * (1 + (int)rng_below(rng, WHEEL_LEVELS));
+        uint64_t delta = 1 + (rng_next(rng) & (((uint64_t)1 << bits) - 1));
+        arm(wheel, &timers[num_timers++], now + delta, rng);
+    }
+}
+
+// Cancel every fourth pending timer from first on and move every fifth to a new time
+static void disturb(TimerWheel *wheel, uint64_t now, int first, Rng *rng) {
+    for (int i = first; i < num_timers; i++) {
+        TestTimer *t = &timers[i];
+        if (!t->armed || t->fired)
+            continue;
+        if (i % 4 == 0) {
+            timer_cancel(wheel, &t->timer);
+            t->armed = 0;
+        } else if (i % 5 == 0) {
+            arm(wheel, t, now + 1 + rng_below(rng, 1u << (WHEEL_BITS * 3)), rng);
+        }
+    }
+}
+
+// Check the timers handed back at tick now and mark them fired
+static int collect(Timer *fired, uint64_t now, uint64_t earliest) {
+    for (Timer *timer = fired; timer; timer = timer->next) {
+        TestTimer *t = (TestTimer *)timer->owner;
+        if (!t->armed) {
+            printf("Timer %d fired after being cancelled\n", (int)(t - timers));
+            return 0;
+        }
+        if (t->fired) {
+            printf("Timer %d fired twice\n", (int)(t - timers));
+            return 0;
+        }
+        if (t->due > now || t->due < earliest) {
+            printf("Timer %d due at tick %llu fired at tick %llu\n", (int)(t - timers),
+                   (unsigned long long)t->due, (unsigned long long)now);
+            return 0;
+        }
+        t->fired = 1;
+    }
+    return 1;
+}
+
+static int all_fired(const TimerWheel *wheel) {
+    for (int i = 0; i < num_timers; i++) {
+        if (timers[i].armed && !timers[i].fired) {
+            printf("Timer %d due at tick %llu never fired\n", i, (unsigned long long)timers[i].due);
+            return 0;
+        }
+    }
+    if (wheel->count != 0) {
+        printf("%zu timers left on the wheel\n", wheel->count);
+        return 0;
+    }
+    return 1;
+}
+
+// Test single-tick stepping across every level boundary, with timers armed and cancelled mid-run
+int test_fire_at_due_tick() {
+    static const uint64_t stops[] = {0, 1, 63, 64, 65, 4095, 4096, 70000, 262143, 262144, 5000001};
+    TimerWheel wheel;
+    Rng rng;
+    uint64_t last = 0;
+    int next_stop = 0;
+
+    printf("Testing that each timer fires once at its due tick...\n");
+    memset(timers, 0, sizeof(timers));
+    num_timers = 0;
+    rng_seed(&rng, 3, 1);
+    timer_wheel_init(&wheel, ORIGIN_NS, TICK_NS);
+
+    for (uint64_t now = 0;; now++) {
+        // Arm and disturb timers at a few ticks, some aligned to a block and some not
+        if (next_stop < (int)(sizeof(stops) / sizeof(stops[0])) && now == stops[next_stop]) {
+            int first = num_timers;
+            arm_batch(&wheel, now, 200, &rng);
+            disturb(&wheel, now, first / 2, &rng);
+            next_stop++;
+            for (int i = 0; i < num_timers; i++)
+                if (timers[i].armed && !timers[i].fired && timers[i].due > last)
+                    last = timers[i].due;
+        }
+        if (!collect(timer_wheel_expire(&wheel, ORIGIN_NS + now * TICK_NS), now, now))
+            return 0;
+        if (now > last && next_stop == (int)(sizeof(stops) / sizeof(stops[0])))
+            break;
+    }
+    if (!all_fired(&wheel))
+        return 0;
+    printf("Due tick test PASSED\n");
+    return 1;
+}
+
+// Test jumping straight to timer_wheel_next(), re-arming some timers from their expiry
+int test_next_deadline() {
+    TimerWheel wheel;
+    Rng rng;
+    uint64_t prev = 0;
+    int rearms = 0;
+
+    printf("Testing timer_wheel_next()...\n");
+    memset(timers, 0, sizeof(timers));
+    num_timers = 0;
+    rng_seed(&rng, 4, 1);
+    timer_wheel_init(&wheel, ORIGIN_NS, TICK_NS);
+    arm_batch(&wheel, 0, 1500, &rng);
+    disturb(&wheel, 0, 0, &rng);
+
+    for (;;) {
+        uint64_t next_ns = timer_wheel_next(&wheel);
+        if (next_ns == UINT64_MAX)
+            break;
+        uint64_t now = (next_ns - ORIGIN_NS) / TICK_NS;
+        for (int i = 0; i < num_timers; i++) {
+            if (timers[i].armed && !timers[i].fired && timers[i].due < now) {
+                printf("timer_wheel_next() is tick %llu, past timer %d due at tick %llu\n",
+                       (unsigned long long)now, i, (unsigned long long)timers[i].due);
+                return 0;
+            }
+        }
+        Timer *fired = timer_wheel_expire(&wheel, next_ns);
+        if (!collect(fired, now, prev + 1))
+            return 0;
+        prev = now;
+        // A fired timer may be armed again straight away
+        for (Timer *timer = fired, *next; timer; timer = next) {
+            next = timer->next;
+            TestTimer *t = (TestTimer *)timer->owner;
+            if (rearms < 500 && rng_below(&rng, 4) == 0) {
+                t->fired = 0;
+                arm(&wheel, t, now + 1 + rng_below(&rng, 1u << (WHEEL_BITS * 2 + 2)), &rng);
+                rearms++;
+            }
+        }
+    }
+    if (!all_fired(&wheel))
+        return 0;
+    printf("Next deadline test PASSED\n");
+    return 1;
+}
+
+int main() {
+    printf("=== Timer Wheel Test Suite ===\n\n");
+
+    if (!test_fire_at_due_tick()) {
+        printf("Due tick test FAILED\n");
+        return 1;
+    }
+    if (!test_next_deadline()) {
+        printf("Next deadline test FAILED\n");
+        return 1;
+    }
+
+    printf("\nAll tests passed\n");
+    return 0;
+}
@@ -0,0 +1,209 @@
+/**
+ * test_wire.c - Test program for the v2 wire format in wire.c
+ *
+ * This program checks the pieces every v2 frame depends on, without any
+ * sockets:
+ * 1. crc32c() against the standard CRC-32C check value
+ * 2. Extending a CRC over a buffer in pieces
+ * 3. Building, sealing and parsing a v2 header
+ * 4. frame_crc() over a header, payload and padding
+ * 5. The SSE4.2 kernel against slicing-by-8 at every length and alignment
+ *
+ * crc32c.c is included rather than linked so the test can reach both kernels.
+ */
+
+#include "crc32c.c"
+
+// Bit-at-a-time CRC-32C, the definition the real kernels must agree with
+static uint32_t crc32c_reference(const unsigned char *p, size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+    }
+    return ~crc;
+}
+
+// Test the CRC of "123456789" against the published check value
+int test_check_value() {
+    printf("Testing the CRC-32C check value...\n");
+    uint32_t crc = crc32c(0, "123456789", 9);
+    if (crc != 0xE3069283) {
+        printf("crc32c(\"123456789\") = %08X, expected E3069283\n", crc);
+        return 0;
+    }
+    if (crc32c(0, "", 0) != 0) {
+        printf("CRC of no bytes is not 0\n");
+        return 0;
+    }
+    printf("Check value test PASSED\n");
+    return 1;
+}
+
+// Test that a CRC carried over several calls matches one call over the whole buffer
+int test_incremental() {
+    unsigned char buf[5000];
+    Rng rng;
+
+    printf("Testing incremental CRCs...\n");
+    rng_seed(&rng, 1, 1);
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = (unsigned char)rng_next(&rng);
+
+    uint32_t whole = crc32c(0, buf, sizeof(buf));
+    if (whole != crc32c_reference(buf, sizeof(buf))) {
+        printf("crc32c() disagrees with the bitwise reference\n");
+        return 0;
+    }
+    for (size_t cut = 0; cut <= sizeof(buf); cut += 37) {
+        uint32_t parts = crc32c(crc32c(0, buf, cut), buf + cut, sizeof(buf) - cut);
+        if (parts != whole) {
+            printf("Split at %zu: %08X, expected %08X\n", cut, parts, whole);
+            return 0;
+        }
+    }
+    printf("Incremental CRC test PASSED\n");
+    return 1;
+}
+
+// Test that a sealed header parses back to the fields it was built from
+int test_header_round_trip() {
+    char hdr[HEADER_V2_SIZE];
+    FrameHeader fh;
+    static const uint8_t flags[] = {FRAME_DATA, FRAME_DATA | FRAME_COMPACT, FRAME_NOISE, FRAME_ACK};
+
+    printf("Testing v2 header round trip...\n");
+    for (int i = 0; i < 4; i++) {
+        uint16_t station_id = (uint16_t)(0xFFFF - i * 1000);
+        uint32_t seq = 0xFEDCBA98u + (uint32_t)i;
+        uint32_t payload_len = 1000 + i;
+        uint32_t body_len = flags[i] & FRAME_DATA ? 4096 : 0;
+        build_header_v2(hdr, flags[i], station_id, seq, payload_len, body_len);
+        header_v2_seal(hdr, 0xDEADBEEF);
+
+        if (!header_v2_parse(hdr, &fh)) {
+            printf("Header %d not recognised as v2\n", i);
+            return 0;
+        }
+        if (fh.flags != flags[i] || fh.station_id != station_id || fh.seq != seq ||
+            fh.payload_len != payload_len || fh.body_len != body_len || fh.crc != 0xDEADBEEF) {
+            printf("Header %d came back with different fields\n", i);
+            return 0;
+        }
+        // The ethertype sits where the v1 header has it, so v1 code still finds the body length
+        if ((uint8_t)hdr[12] != (ETHERTYPE_V2 >> 8) || (uint8_t)hdr[13] != (ETHERTYPE_V2 & 0xFF)) {
+            printf("Header %d has the ethertype out of place\n", i);
+            return 0;
+        }
+    }
+
+    memset(hdr, 0, sizeof(hdr));
+    hdr[12] = ETHERTYPE_DATA >> 8;
+    hdr[13] = ETHERTYPE_DATA & 0xFF;
+    if (header_v2_parse(hdr, &fh)) {
+        printf("A v1 header parsed as v2\n");
+        return 0;
+    }
+    printf("Header round trip test PASSED\n");
+    return 1;
+}
+
+// Test that frame_crc() sums the first 18 header bytes, the payload and the padding
+int test_frame_crc() {
+    char hdr[HEADER_V2_SIZE];
+    char frame[HEADER_SIZE + 300];
+    char payload[200];
+    char padding[100];
+
+    printf("Testing frame_crc()...\n");
+    memset(payload, 'p', sizeof(payload));
+    memset(padding, 0, sizeof(padding));
+    build_header_v2(hdr, FRAME_DATA, 42, 9, sizeof(payload), sizeof(payload) + sizeof(padding));
+    memcpy(frame, hdr, HEADER_SIZE);
+    memcpy(frame + HEADER_SIZE, payload, sizeof(payload));
+    memcpy(frame + HEADER_SIZE + sizeof(payload), padding, sizeof(padding));
+
+    uint32_t crc = frame_crc(hdr, payload, sizeof(payload), padding, sizeof(padding));
+    if (crc != crc32c_reference((const unsigned char *)frame, sizeof(frame))) {
+        printf("frame_crc() doesn't cover header, payload and padding in order\n");
+        return 0;
+    }
+    header_v2_seal(hdr, crc);
+    if (frame_crc(hdr, payload, sizeof(payload), padding, sizeof(padding)) != crc) {
+        printf("Sealing changed the CRC of the header\n");
+        return 0;
+    }
+    printf("frame_crc test PASSED\n");
+    return 1;
+}
+
+// Test the SSE4.2 kernel against slicing-by-8 on every length up to past one three-stripe
+// block, starting at each offset within an 8-byte word
+int test_kernels() {
+    enum { MAX_LEN = 3 * CRC32C_STRIPE + 64 };
+    static unsigned char buf[MAX_LEN + 8];
+    Rng rng;
+
+    printf("Testing the CRC32C kernels...\n");
+    rng_seed(&rng, 2, 1);
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = (unsigned char)rng_next(&rng);
+    crc32c(0, "", 0); // builds the tables and the stripe shifts
+
+    for (size_t len = 0; len <= 300; len++) {
+        if (~crc32c_sw(~0u, buf, len) != crc32c_reference(buf, len)) {
+            printf("Slicing-by-8 disagrees with the bitwise reference at length %zu\n", len);
+            return 0;
+        }
+    }
+#ifdef CRC32C_HW
+    if (!__builtin_cpu_supports("sse4.2")) {
+        printf("No SSE4.2 on this CPU, only slicing-by-8 checked\n");
+    } else {
+        for (int align = 0; align < 8; align++) {
+            for (size_t len = 0; len <= MAX_LEN; len++) {
+                uint32_t seed = (uint32_t)rng_next(&rng);
+                uint32_t sw = crc32c_sw(seed, buf + align, len);
+                uint32_t hw = crc32c_sse42(seed, buf + align, len);
+                if (sw != hw) {
+                    printf("Length %zu at offset %d: SSE4.2 %08X, slicing-by-8 %08X\n", len, align, hw, sw);
+                    return 0;
+                }
+            }
+        }
+    }
+#else
+    printf("No SSE4.2 kernel in this build, only slicing-by-8 checked\n");
+#endif
+    printf("Kernel test PASSED\n");
+    return 1;
+}
+
+int main() {
+    printf("=== Wire Format Test Suite ===\n\n");
+
+    if (!test_check_value()) {
+        printf("Check value test FAILED\n");
+        return 1;
+    }
+    if (!test_incremental()) {
+        printf("Incremental CRC test FAILED\n");
+        return 1;
+    }
+    if (!test_header_round_trip()) {
+        printf("Header round trip test FAILED\n");
+        return 1;
+    }
+    if (!test_frame_crc()) {
+        printf("frame_crc test FAILED\n");
+        return 1;
+    }
+    if (!test_kernels()) {
+        printf("Kernel test FAILED\n");
+        return 1;
+    }
+
+    printf("\nAll tests passed\n");
+    return 0;
+}
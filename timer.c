@@ -0,0 +1,195 @@
+#include "header.h"
+
+// Hierarchical timer wheel in the style of the classic Linux kernel timers. Level 0 has one
+// slot per tick for the next WHEEL_SIZE ticks, and each level above covers WHEEL_SIZE times
+// the span of the one below. Scheduling and cancelling are O(1). A higher-level slot is
+// cascaded into the levels below when the wheel reaches its block, so each timer moves at
+// most WHEEL_LEVELS - 1 times before it fires.
+
+#define WHEEL_SPAN ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) // ticks covered by the whole wheel
+
+static int lowest_bit(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(value);
+#else
+    int bit = 0;
+    while (!(value & 1))
+    {
+        value >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static void wheel_insert(TimerWheel *wheel, Timer *timer)
+{
+    uint64_t at = timer->expires > wheel->now ? timer->expires : wheel->now;
+    uint64_t delta = at - wheel->now;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (uint64_t)1 << (WHEEL_BITS * (level + 1)))
+        level++;
+    if (delta >= WHEEL_SPAN)
+        at = wheel->now + WHEEL_SPAN - 1; // parked in the last slot; cascading re-files it
+    int slot = (int)((at >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1));
+
+    Timer **head = &wheel->slots[level][slot];
+    timer->prev = NULL;
+    timer->next = *head;
+    if (*head)
+        (*head)->prev = timer;
+    *head = timer;
+    timer->level = level;
+    timer->slot = slot;
+    timer->pending = 1;
+    wheel->occupied[level] |= (uint64_t)1 << slot;
+    wheel->count++;
+}
+
+static void wheel_unlink(TimerWheel *wheel, Timer *timer)
+{
+    if (timer->prev)
+        timer->prev->next = timer->next;
+    else
+        wheel->slots[timer->level][timer->slot] = timer->next;
+    if (timer->next)
+        timer->next->prev = timer->prev;
+    if (!wheel->slots[timer->level][timer->slot])
+        wheel->occupied[timer->level] &= ~((uint64_t)1 << timer->slot);
+    timer->pending = 0;
+    wheel->count--;
+}
+
+// Lowest set bit of occupied at or after slot "from", counting round the wheel
+static int next_occupied(uint64_t occupied, int from)
+{
+    uint64_t rotated = from ? (occupied >> from) | (occupied << (WHEEL_SIZE - from)) : occupied;
+    return lowest_bit(rotated);
+}
+
+// First tick at which a non-empty slot above level 0 is cascaded, or UINT64_MAX if there is none
+static uint64_t next_cascade(const TimerWheel *wheel)
+{
+    uint64_t tick = UINT64_MAX;
+    for (int level = 1; level < WHEEL_LEVELS; level++)
+    {
+        if (!wheel->occupied[level])
+            continue;
+        int shift = WHEEL_BITS * level;
+        uint64_t block = wheel->now >> shift;
+        if (wheel->now & (((uint64_t)1 << shift) - 1))
+            block++; // this block's slot was cascaded on entry
+        block += (uint64_t)next_occupied(wheel->occupied[level], (int)(block & (WHEEL_SIZE - 1)));
+        if (block << shift < tick)
+            tick = block << shift;
+    }
+    return tick;
+}
+
+// Re-file the timers of the slot the wheel just entered at each level above 0
+static void wheel_cascade(TimerWheel *wheel)
+{
+    for (int level = 1; level < WHEEL_LEVELS; level++)
+    {
+        int slot = (int)((wheel->now >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1));
+        Timer *timer = wheel->slots[level][slot];
+        wheel->slots[level][slot] = NULL;
+        wheel->occupied[level] &= ~((uint64_t)1 << slot);
+        while (timer)
+        {
+            Timer *next = timer->next;
+            wheel->count--;
+            wheel_insert(wheel, timer);
+            timer = next;
+        }
+        if (slot != 0)
+            break; // the next level only turns when this one wraps
+    }
+}
+
+void timer_wheel_init(TimerWheel *wheel, uint64_t origin_ns, uint64_t tick_ns)
+{
+    memset(wheel, 0, sizeof(TimerWheel));
+    wheel->origin = origin_ns;
+    wheel->tick_ns = tick_ns > 0 ? tick_ns : 1;
+}
+
+// Arm (or re-arm) a timer to fire at when_ns. Expiry is rounded up to the next tick, so a timer
+// never fires early.
+void timer_schedule(TimerWheel *wheel, Timer *timer, uint64_t when_ns)
+{
+    if (timer->pending)
+        wheel_unlink(wheel, timer);
+    timer->expires = when_ns > wheel->origin ? (when_ns - wheel->origin + wheel->tick_ns - 1) / wheel->tick_ns : 0;
+    wheel_insert(wheel, timer);
+}
+
+void timer_cancel(TimerWheel *wheel, Timer *timer)
+{
+    if (timer->pending)
+        wheel_unlink(wheel, timer);
+}
+
+// Move the wheel up to now_ns and return the timers that came due, unlinked and chained through
+// next in expiry order. A fired timer may be scheduled again straight away.
+Timer *timer_wheel_expire(TimerWheel *wheel, uint64_t now_ns)
+{
+    if (now_ns < wheel->origin)
+        return NULL;
+    uint64_t target = (now_ns - wheel->origin) / wheel->tick_ns;
+    Timer *fired = NULL;
+    Timer **tail = &fired;
+
+    while (wheel->now <= target)
+    {
+        if (wheel->count == 0)
+        {
+            wheel->now = target + 1;
+            break;
+        }
+        int slot = (int)(wheel->now & (WHEEL_SIZE - 1));
+        if (slot == 0)
+            wheel_cascade(wheel);
+
+        Timer *timer = wheel->slots[0][slot];
+        if (timer)
+        {
+            wheel->slots[0][slot] = NULL;
+            wheel->occupied[0] &= ~((uint64_t)1 << slot);
+            for (; timer; timer = timer->next)
+            {
+                timer->pending = 0;
+                wheel->count--;
+                *tail = timer;
+                tail = &timer->next;
+            }
+            *tail = NULL;
+        }
+
+        wheel->now++;
+        if (!wheel->occupied[0])
+        {
+            // Nothing due before the next cascade: skip straight to it
+            uint64_t cascade = next_cascade(wheel);
+            wheel->now = cascade <= target ? cascade : target + 1;
+        }
+    }
+    return fired;
+}
+
+// Time at which timer_wheel_expire() may next return something, or UINT64_MAX with no timers
+// armed. Beyond level 0 this is the next cascade, which may turn out to have nothing due.
+uint64_t timer_wheel_next(const TimerWheel *wheel)
+{
+    if (wheel->count == 0)
+        return UINT64_MAX;
+    uint64_t tick = next_cascade(wheel);
+    if (wheel->occupied[0])
+    {
+        uint64_t due = wheel->now + (uint64_t)next_occupied(wheel->occupied[0], (int)(wheel->now & (WHEEL_SIZE - 1)));
+        if (due < tick)
+            tick = due;
+    }
+    return wheel->origin + tick * wheel->tick_ns;
+}
@@ -0,0 +1,656 @@
+#include "header.h"
+
+// io_uring channel: the single-threaded slot loop with its socket I/O submitted to the kernel
+// through a shared ring pair instead of being performed after readiness polling. Accepts come
+// from one multishot request. Receives take a buffer from a ring of RX_AHEAD_SIZE buffers the
+// kernel picks from when data arrives, and that buffer becomes the station's read-ahead until
+// parsed; long payload remainders are still read straight into place. Replies are only queued
+// by the slot code and go out as one SENDMSG per station, so a slot with hundreds of stations
+// costs one io_uring_enter() rather than a write per station.
+//
+// Each station has at most one receive and one send in flight. One send at a time keeps a
+// station's replies in order without linking requests, and one receive keeps TCP backpressure:
+// a station that runs ahead of its slots is simply not read.
+
+#ifdef __linux__
+
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define UR_ENTRIES 1024      // submission queue; completions get UR_CQ_FACTOR times as many
+#define UR_CQ_FACTOR 8
+#define UR_BUFFERS 512       // provided receive buffers, RX_AHEAD_SIZE each (power of two)
+#define UR_BUFFER_GROUP 0
+#define UR_DRAIN_ROUNDS 20   // 50 ms waits for cancelled requests to complete at shutdown
+
+// user_data: the station's record with the request type in its low bits (records are malloc'ed)
+#define UR_ACCEPT 0
+#define UR_RECV 1
+#define UR_RECV_DIRECT 2
+#define UR_SEND 3
+#define UR_TAG_MASK 3
+
+typedef struct Uring
+{
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    unsigned sqe_tail;      // next free SQE; published to sq_tail at io_uring_enter()
+    unsigned sq_submitted;  // SQEs handed to the kernel so far
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    size_t sqe_map_size;
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *buf_base;
+    unsigned short buf_tail;
+    int inflight;           // requests not yet completed, all stations and the accept
+} Uring;
+
+typedef struct UringStation
+{
+    int inflight;
+    int recv_armed;
+    int send_armed;
+    int closing;            // detached from the channel; freed once nothing is in flight
+    int buf_id;             // provided buffer held as rx_ahead, -1 for none
+    struct iovec iov[2 * TX_BATCH]; // read by the send in flight until it completes
+    struct msghdr msg;
+    OutputChannel *next_closing;
+} UringStation;
+
+typedef struct UringChannel
+{
+    Uring ring;
+    SOCKET listener;
+    int accept_armed;
+    OutputChannel *head;
+    OutputChannel *current;
+    StationTable table;
+    NoiseTemplate noise;
+    OutputChannel *closing; // detached stations waiting for their requests to complete
+    int stopping;           // completions are only collected, nothing is re-armed
+    LogQueue *log;
+} UringChannel;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void uring_unmap(Uring *ur)
+{
+    if (ur->sqes)
+        munmap(ur->sqes, ur->sqe_map_size);
+    if (ur->cq_map && ur->cq_map != ur->sq_map)
+        munmap(ur->cq_map, ur->cq_map_size);
+    if (ur->sq_map)
+        munmap(ur->sq_map, ur->sq_map_size);
+    if (ur->buf_ring)
+        munmap(ur->buf_ring, ur->buf_ring_size);
+    free(ur->buf_base);
+}
+
+// Set up the rings and the provided receive buffers. Returns 0 if the kernel can't do it.
+static int uring_init(Uring *ur)
+{
+    memset(ur, 0, sizeof(Uring));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // Only this thread submits, and completion work may wait until it asks for events
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    p.cq_entries = UR_ENTRIES * UR_CQ_FACTOR;
+    ur->fd = sys_io_uring_setup(UR_ENTRIES, &p);
+    if (ur->fd < 0 && errno == EINVAL)
+    {
+        memset(&p, 0, sizeof(p)); // kernels before 6.1
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = UR_ENTRIES * UR_CQ_FACTOR;
+        ur->fd = sys_io_uring_setup(UR_ENTRIES, &p);
+    }
+    if (ur->fd < 0)
+    {
+        fprintf(stderr, "io_uring_setup failed: %d\n", errno);
+        return 0;
+    }
+    if (!(p.features & IORING_FEAT_EXT_ARG))
+    {
+        fprintf(stderr, "io_uring needs Linux 5.11 or later\n");
+        close(ur->fd);
+        return 0;
+    }
+
+    ur->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ur->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ur->cq_map_size > ur->sq_map_size)
+            ur->sq_map_size = ur->cq_map_size;
+        ur->cq_map_size = ur->sq_map_size;
+    }
+    ur->sq_map = mmap(NULL, ur->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+    if (ur->sq_map == MAP_FAILED)
+        ur->sq_map = NULL;
+    ur->cq_map = ur->sq_map;
+    if (ur->sq_map && !(p.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        ur->cq_map = mmap(NULL, ur->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_CQ_RING);
+        if (ur->cq_map == MAP_FAILED)
+            ur->cq_map = NULL;
+    }
+    ur->sqe_map_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (ur->cq_map)
+    {
+        ur->sqes = (struct io_uring_sqe *)mmap(NULL, ur->sqe_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                               ur->fd, IORING_OFF_SQES);
+        if (ur->sqes == MAP_FAILED)
+            ur->sqes = NULL;
+    }
+    if (!ur->sqes)
+    {
+        fprintf(stderr, "Failed to map the io_uring rings: %d\n", errno);
+        uring_unmap(ur);
+        close(ur->fd);
+        return 0;
+    }
+    char *sq = (char *)ur->sq_map;
+    char *cq = (char *)ur->cq_map;
+    ur->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ur->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ur->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    ur->sq_entries = p.sq_entries;
+    ur->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ur->sqe_tail = *ur->sq_tail;
+    ur->sq_submitted = ur->sqe_tail;
+    ur->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ur->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ur->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    ur->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // Receive buffers: the kernel takes one from the ring as data arrives, we put it back once
+    // its bytes are parsed
+    ur->buf_ring_size = UR_BUFFERS * sizeof(struct io_uring_buf);
+    ur->buf_ring = (struct io_uring_buf_ring *)mmap(NULL, ur->buf_ring_size, PROT_READ | PROT_WRITE,
+                                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ur->buf_ring == MAP_FAILED)
+        ur->buf_ring = NULL;
+    ur->buf_base = (char *)malloc((size_t)UR_BUFFERS * RX_AHEAD_SIZE);
+    if (!ur->buf_ring || !ur->buf_base)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        uring_unmap(ur);
+        close(ur->fd);
+        return 0;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ur->buf_ring;
+    reg.ring_entries = UR_BUFFERS;
+    reg.bgid = UR_BUFFER_GROUP;
+    if (sys_io_uring_register(ur->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        fprintf(stderr, "Provided buffer rings need Linux 5.19 or later: %d\n", errno);
+        uring_unmap(ur);
+        close(ur->fd);
+        return 0;
+    }
+    for (int i = 0; i < UR_BUFFERS; i++)
+    {
+        struct io_uring_buf *buf = &ur->buf_ring->bufs[i];
+        buf->addr = (uint64_t)(uintptr_t)(ur->buf_base + (size_t)i * RX_AHEAD_SIZE);
+        buf->len = RX_AHEAD_SIZE;
+        buf->bid = (uint16_t)i;
+    }
+    ur->buf_tail = UR_BUFFERS;
+    __atomic_store_n(&ur->buf_ring->tail, ur->buf_tail, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void uring_buffer_return(Uring *ur, int id)
+{
+    struct io_uring_buf *buf = &ur->buf_ring->bufs[ur->buf_tail & (UR_BUFFERS - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ur->buf_base + (size_t)id * RX_AHEAD_SIZE);
+    buf->len = RX_AHEAD_SIZE;
+    buf->bid = (uint16_t)id;
+    ur->buf_tail++;
+    __atomic_store_n(&ur->buf_ring->tail, ur->buf_tail, __ATOMIC_RELEASE);
+}
+
+// Hand queued SQEs to the kernel and, with wait set, run completions until at least one is in
+// or timeout_ns passes. Returns 0 on a ring error.
+static int uring_enter(Uring *ur, int wait, uint64_t timeout_ns)
+{
+    __atomic_store_n(ur->sq_tail, ur->sqe_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = ur->sqe_tail - ur->sq_submitted;
+    struct __kernel_timespec ts;
+    ts.tv_sec = (long long)(timeout_ns / NS_PER_SEC);
+    ts.tv_nsec = (long long)(timeout_ns % NS_PER_SEC);
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+    int ret = sys_io_uring_enter(ur->fd, to_submit, wait ? 1 : 0, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                                 &arg, sizeof(arg));
+    if (ret >= 0)
+    {
+        ur->sq_submitted += (unsigned)ret;
+        return 1;
+    }
+    // A signal (Ctrl+Z), the timeout, or a full completion queue we are about to drain anyway
+    return errno == EINTR || errno == ETIME || errno == EBUSY || errno == EAGAIN;
+}
+
+// Next free SQE, zeroed. Submits what is queued first if the ring is full; NULL if that fails.
+static struct io_uring_sqe *uring_sqe(Uring *ur)
+{
+    if (ur->sqe_tail - __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE) >= ur->sq_entries)
+    {
+        __atomic_store_n(ur->sq_tail, ur->sqe_tail, __ATOMIC_RELEASE);
+        int ret = sys_io_uring_enter(ur->fd, ur->sqe_tail - ur->sq_submitted, 0, 0, NULL, 0);
+        if (ret > 0)
+            ur->sq_submitted += (unsigned)ret;
+        if (ur->sqe_tail - __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE) >= ur->sq_entries)
+        {
+            fprintf(stderr, "io_uring submission queue full\n");
+            return NULL;
+        }
+    }
+    unsigned index = ur->sqe_tail & ur->sq_mask;
+    struct io_uring_sqe *sqe = &ur->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ur->sq_array[index] = index;
+    ur->sqe_tail++;
+    ur->inflight++;
+    return sqe;
+}
+
+static void uring_arm_accept(UringChannel *uc)
+{
+    struct io_uring_sqe *sqe = uring_sqe(&uc->ring);
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = uc->listener;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT; // one request, a completion per connection
+    sqe->user_data = UR_ACCEPT;
+    uc->accept_armed = 1;
+}
+
+// Read the station's next bytes, unless it has sent this slot or still has bytes to parse
+static void uring_arm_recv(UringChannel *uc, OutputChannel *ptr)
+{
+    UringStation *us = ptr->uring;
+    if (us->recv_armed || us->closing || ptr->send_in_slot || rx_buffered(ptr))
+        return;
+    struct io_uring_sqe *sqe = uring_sqe(&uc->ring);
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = ptr->socket;
+    char *dst;
+    int direct = rx_direct_want(ptr, &dst);
+    if (direct)
+    {
+        sqe->addr = (uint64_t)(uintptr_t)dst;
+        sqe->len = (unsigned)direct;
+        sqe->user_data = (uint64_t)(uintptr_t)ptr | UR_RECV_DIRECT;
+    }
+    else
+    {
+        sqe->flags = IOSQE_BUFFER_SELECT; // the kernel picks a buffer when data is in
+        sqe->buf_group = UR_BUFFER_GROUP;
+        sqe->user_data = (uint64_t)(uintptr_t)ptr | UR_RECV;
+    }
+    us->recv_armed = 1;
+    us->inflight++;
+}
+
+// Send up to TX_BATCH queued replies, unless a send is in flight already
+static void uring_arm_send(UringChannel *uc, OutputChannel *ptr)
+{
+    UringStation *us = ptr->uring;
+    if (us->send_armed || us->closing || !ptr->tx_head)
+        return;
+    struct io_uring_sqe *sqe = uring_sqe(&uc->ring);
+    if (!sqe)
+        return;
+    const char *bufs[2 * TX_BATCH];
+    int lens[2 * TX_BATCH];
+    long total;
+    int count = tx_gather(ptr, bufs, lens, &total);
+    for (int i = 0; i < count; i++)
+    {
+        us->iov[i].iov_base = (void *)bufs[i];
+        us->iov[i].iov_len = (size_t)lens[i];
+    }
+    memset(&us->msg, 0, sizeof(us->msg));
+    us->msg.msg_iov = us->iov;
+    us->msg.msg_iovlen = (size_t)count;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = ptr->socket;
+    sqe->addr = (uint64_t)(uintptr_t)&us->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t)(uintptr_t)ptr | UR_SEND;
+    us->send_armed = 1;
+    us->inflight++;
+}
+
+// Give back the station's receive buffer once everything in it is parsed
+static void uring_release_buffer(UringChannel *uc, OutputChannel *ptr)
+{
+    UringStation *us = ptr->uring;
+    if (us->buf_id < 0 || rx_buffered(ptr))
+        return;
+    uring_buffer_return(&uc->ring, us->buf_id);
+    us->buf_id = -1;
+    ptr->rx_ahead = NULL;
+    ptr->rx_ahead_pos = 0;
+    ptr->rx_ahead_len = 0;
+}
+
+static void uring_station_free(UringChannel *uc, OutputChannel *ptr)
+{
+    UringStation *us = ptr->uring;
+    if (us->buf_id >= 0)
+        uring_buffer_return(&uc->ring, us->buf_id);
+    ptr->rx_ahead = NULL; // belongs to the buffer ring
+    ptr->uring = NULL;
+    free(us);
+    free_server(ptr);
+}
+
+// Take a departing station off the channel. Its record lives on until its requests complete,
+// which shutting the socket down hurries along.
+static void uring_disconnect(UringChannel *uc, OutputChannel *ptr)
+{
+    UringStation *us = ptr->uring;
+    if (us->closing)
+        return;
+    detach_server(uc->head, &uc->current, &uc->table, ptr, uc->log);
+    us->closing = 1;
+    shutdown(ptr->socket, SHUT_RDWR);
+    us->next_closing = uc->closing;
+    uc->closing = ptr;
+}
+
+// Free the closing stations with nothing left in flight, or all of them with all set
+static void uring_sweep_closing(UringChannel *uc, int all)
+{
+    OutputChannel **link = &uc->closing;
+    while (*link)
+    {
+        OutputChannel *ptr = *link;
+        if (all || ptr->uring->inflight == 0)
+        {
+            *link = ptr->uring->next_closing;
+            uring_station_free(uc, ptr);
+        }
+        else
+        {
+            link = &ptr->uring->next_closing;
+        }
+    }
+}
+
+static void uring_accepted(UringChannel *uc, SOCKET s)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(s, (SOCKADDR *)&addr, &addr_len) == SOCKET_ERROR)
+    {
+        closesocket(s);
+        return;
+    }
+    UringStation *us = (UringStation *)calloc(1, sizeof(UringStation));
+    if (!us)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        closesocket(s);
+        return;
+    }
+    OutputChannel *ptr = add_station(s, &addr, &uc->current);
+    if (!ptr || !index_station(&uc->table, &uc->current, ptr))
+    {
+        free(us);
+        return;
+    }
+    // The ring waits for the socket itself; a non-blocking one would only hand back EAGAIN
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) & ~O_NONBLOCK);
+    us->buf_id = -1;
+    ptr->uring = us;
+    ptr->tx_async = 1;
+    uring_arm_recv(uc, ptr);
+}
+
+static void uring_recv_done(UringChannel *uc, OutputChannel *ptr, int tag, int res, unsigned flags)
+{
+    UringStation *us = ptr->uring;
+    us->recv_armed = 0;
+    if (flags & IORING_CQE_F_BUFFER)
+    {
+        int id = (int)(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (us->closing || uc->stopping || res <= 0)
+        {
+            uring_buffer_return(&uc->ring, id);
+        }
+        else
+        {
+            us->buf_id = id;
+            ptr->rx_ahead = uc->ring.buf_base + (size_t)id * RX_AHEAD_SIZE;
+            ptr->rx_ahead_pos = 0;
+            ptr->rx_ahead_len = res;
+        }
+    }
+    if (us->closing || uc->stopping)
+        return;
+    if (res == -ENOBUFS || res == -EAGAIN || res == -EINTR)
+    {
+        // Out of receive buffers: retried at the next slot boundary, once some are parsed
+        if (res != -ENOBUFS)
+            uring_arm_recv(uc, ptr);
+        return;
+    }
+    if (res <= 0)
+    {
+        uring_disconnect(uc, ptr);
+        return;
+    }
+    RxStatus status = tag == UR_RECV_DIRECT ? rx_advance(uc->head, ptr, res) : rx_parse(uc->head, ptr);
+    if (status == RX_CLOSED)
+    {
+        uring_disconnect(uc, ptr);
+        return;
+    }
+    uring_release_buffer(uc, ptr);
+    uring_arm_recv(uc, ptr);
+}
+
+static void uring_send_done(UringChannel *uc, OutputChannel *ptr, int res)
+{
+    UringStation *us = ptr->uring;
+    us->send_armed = 0;
+    if (us->closing || uc->stopping)
+        return;
+    if (res > 0)
+    {
+        tx_advance(ptr, res);
+    }
+    else if (res != -EAGAIN && res != -EINTR)
+    {
+        fprintf(stderr, "Error sending data: %d\n", -res);
+        clear_tx(ptr); // the read side will see the disconnect
+        return;
+    }
+    uring_arm_send(uc, ptr);
+}
+
+// Handle every completion posted so far
+static void uring_reap(UringChannel *uc)
+{
+    Uring *ur = &uc->ring;
+    unsigned head = *ur->cq_head;
+    unsigned tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+    {
+        struct io_uring_cqe *cqe = &ur->cqes[head & ur->cq_mask];
+        uint64_t data = cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        if (!(flags & IORING_CQE_F_MORE))
+            ur->inflight--;
+
+        int tag = (int)(data & UR_TAG_MASK);
+        OutputChannel *ptr = (OutputChannel *)(uintptr_t)(data & ~(uint64_t)UR_TAG_MASK);
+        if (!ptr)
+        {
+            if (!(flags & IORING_CQE_F_MORE))
+                uc->accept_armed = 0; // re-armed at the next loop pass
+            if (res >= 0 && uc->stopping)
+                closesocket(res);
+            else if (res >= 0)
+                uring_accepted(uc, res);
+            continue;
+        }
+        ptr->uring->inflight--;
+        if (tag == UR_SEND)
+            uring_send_done(uc, ptr, res);
+        else
+            uring_recv_done(uc, ptr, tag, res, flags);
+    }
+    __atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+    uring_sweep_closing(uc, 0);
+}
+
+// Run the channel on an io_uring until Ctrl+Z. Returns 0 if the ring could not be set up.
+int run_uring(SOCKET tcp_s, const Input *c1, LogQueue *log)
+{
+    UringChannel uc;
+    memset(&uc, 0, sizeof(uc));
+    uc.listener = tcp_s;
+    uc.log = log;
+    uc.head = (OutputChannel *)calloc(1, sizeof(OutputChannel));
+    if (!uc.head || !station_table_init(&uc.table, 64))
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(uc.head);
+        return 0;
+    }
+    uc.current = uc.head;
+    if (!uring_init(&uc.ring))
+    {
+        station_table_free(&uc.table);
+        free(uc.head);
+        return 0;
+    }
+    printf("Channel running on io_uring\n");
+
+    SlotClock clock;
+    slot_clock_init(&clock, c1->slot_time);
+    int senders_seen = 0;
+    int ok = 1;
+    while (1)
+    {
+        if (stop_flag)
+        {
+            printf("\nCtrl+Z detected. Finalizing logs...\n");
+            for (OutputChannel *ptr = uc.head->next; ptr; ptr = ptr->next)
+                log_server_stats(ptr, log);
+            break;
+        }
+        if (!uc.accept_armed)
+            uring_arm_accept(&uc);
+
+        if (slot_clock_remaining(&clock) == 0)
+        {
+            resolve_slot(uc.head, &uc.noise);
+            slot_clock_advance(&clock);
+            senders_seen = 0;
+            // Every station may have replies to send now, and the slot's senders may read again
+            OutputChannel *next;
+            for (OutputChannel *ptr = uc.head->next; ptr; ptr = next)
+            {
+                next = ptr->next;
+                if (rx_parse(uc.head, ptr) == RX_CLOSED)
+                {
+                    uring_disconnect(&uc, ptr);
+                    continue;
+                }
+                uring_release_buffer(&uc, ptr);
+                uring_arm_recv(&uc, ptr);
+                uring_arm_send(&uc, ptr);
+            }
+            uring_sweep_closing(&uc, 0);
+            update_slot_end(&c1->mac, &clock, uc.head, &senders_seen);
+        }
+
+        // Submit and sleep until the slot boundary or the first completion
+        uint64_t remaining = slot_clock_remaining(&clock);
+        if (!uring_enter(&uc.ring, remaining > 0, remaining))
+        {
+            fprintf(stderr, "io_uring_enter failed: %d\n", errno);
+            ok = 0;
+            break;
+        }
+        uring_reap(&uc);
+        update_slot_end(&c1->mac, &clock, uc.head, &senders_seen);
+    }
+
+    // Cut every connection short so the requests still in flight complete, then wait for them
+    uc.stopping = 1;
+    for (OutputChannel *ptr = uc.head->next; ptr; ptr = ptr->next)
+        shutdown(ptr->socket, SHUT_RDWR);
+    shutdown(tcp_s, SHUT_RDWR);
+    for (int i = 0; i < UR_DRAIN_ROUNDS && uc.ring.inflight > 0; i++)
+    {
+        if (!uring_enter(&uc.ring, 1, 50 * NS_PER_MS))
+            break;
+        uring_reap(&uc);
+    }
+
+    // A request the drain didn't see complete may still be writing into a station's buffers or the
+    // buffer ring. The kernel lets go of them once the ring is closed, so close it before freeing
+    // anything; the mappings stay valid until unmapped. If requests were still out, leave their
+    // memory alone: the process is about to exit.
+    close(uc.ring.fd);
+    if (uc.ring.inflight > 0)
+    {
+        fprintf(stderr, "%d io_uring requests still in flight, leaving their memory\n", uc.ring.inflight);
+        return ok;
+    }
+    uring_sweep_closing(&uc, 1);
+    for (OutputChannel *ptr = uc.head->next; ptr; ptr = ptr->next)
+    {
+        closesocket(ptr->socket);
+        ptr->rx_ahead = NULL; // belongs to the buffer ring
+        free(ptr->uring);
+        ptr->uring = NULL;
+    }
+    uring_unmap(&uc.ring);
+    if (uc.noise.frame)
+        shared_frame_release(uc.noise.frame);
+    station_table_free(&uc.table);
+    free_list_1(uc.head);
+    return ok;
+}
+
+#endif
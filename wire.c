@@ -0,0 +1,68 @@
+#include "header.h"
+
+// Wire format v2: the v1 header's address fields carry flags, a station id, a sequence number
+// and the payload length, and a CRC32C over header and body follows. Control frames (ACK, NOISE)
+// are a bare header, so a station classifies any reply from its first HEADER_V2_SIZE bytes.
+
+static void put_be16(char *p, uint16_t v)
+{
+    p[0] = (char)(v >> 8);
+    p[1] = (char)v;
+}
+
+static void put_be32(char *p, uint32_t v)
+{
+    p[0] = (char)(v >> 24);
+    p[1] = (char)(v >> 16);
+    p[2] = (char)(v >> 8);
+    p[3] = (char)v;
+}
+
+static uint32_t get_be32(const char *p)
+{
+    return ((uint32_t)(uint8_t)p[0] << 24) | ((uint32_t)(uint8_t)p[1] << 16) | ((uint32_t)(uint8_t)p[2] << 8) | (uint32_t)(uint8_t)p[3];
+}
+
+// Fill in a v2 header with its CRC left at 0; seal it with header_v2_seal() once the body is known
+void build_header_v2(char *packet, uint8_t flags, uint16_t station_id, uint32_t seq, uint32_t payload_len, uint32_t body_len)
+{
+    packet[0] = WIRE_VERSION;
+    packet[1] = (char)flags;
+    put_be32(packet + 2, payload_len);
+    put_be16(packet + 6, station_id);
+    put_be32(packet + 8, seq);
+    put_be16(packet + 12, ETHERTYPE_V2);
+    put_be32(packet + 14, body_len);
+    put_be32(packet + 18, 0);
+}
+
+// CRC of a header's first HEADER_SIZE bytes followed by body_len body bytes: the payload, then
+// zero padding taken from "padding"
+uint32_t frame_crc(const char *header, const char *payload, int payload_len, const char *padding, int padding_len)
+{
+    uint32_t crc = crc32c(0, header, HEADER_SIZE);
+    if (payload_len > 0)
+        crc = crc32c(crc, payload, (size_t)payload_len);
+    if (padding_len > 0)
+        crc = crc32c(crc, padding, (size_t)padding_len);
+    return crc;
+}
+
+void header_v2_seal(char *packet, uint32_t crc)
+{
+    put_be32(packet + 18, crc);
+}
+
+// Split a v2 header into its fields. Returns 0 if it isn't one.
+int header_v2_parse(const char *packet, FrameHeader *fh)
+{
+    if ((uint8_t)packet[0] != WIRE_VERSION || (uint8_t)packet[12] != (ETHERTYPE_V2 >> 8) || (uint8_t)packet[13] != (ETHERTYPE_V2 & 0xFF))
+        return 0;
+    fh->flags = (uint8_t)packet[1];
+    fh->payload_len = get_be32(packet + 2);
+    fh->station_id = (uint16_t)(((uint8_t)packet[6] << 8) | (uint8_t)packet[7]);
+    fh->seq = get_be32(packet + 8);
+    fh->body_len = get_be32(packet + 14);
+    fh->crc = get_be32(packet + 18);
+    return 1;
+}